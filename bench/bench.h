@@ -0,0 +1,86 @@
+/*  Copyright 2010-2018, JP Norair
+  *
+  * Licensed under the OpenTag License, Version 1.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  * http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  */
+
+/**
+  * @file       bench/bench.h
+  * @author     JP Norair
+  * @version    V1.1
+  * @date       27 Jun 2018
+  * @brief      Corpus generator and timing helpers shared by the benchmarks
+  * @ingroup    BinTex
+  ******************************************************************************
+  */
+
+#ifndef __BINTEX_BENCH_H
+#define __BINTEX_BENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Kinds of synthetic corpus
+typedef enum {
+    CORPUS_hex = 0,
+    CORPUS_dec,
+    CORPUS_ascii,
+    CORPUS_comment,
+    CORPUS_mixed,
+    CORPUS_max
+} corpus_kind;
+
+extern const char* const corpus_names[CORPUS_max];
+
+
+
+/** @brief  Look up a corpus kind by name
+  * @param  name        (const char*) "hex", "dec", "ascii", "comment" or "mixed"
+  * @retval (int)       corpus_kind, or -1 if there is no such kind
+  * @ingroup BinTex
+  */
+int corpus_find(const char* name);
+
+
+
+/** @brief  Generate a corpus of valid BinTex, one expression per line
+  * @param  kind        (int) corpus_kind
+  * @param  size        (size_t) length of the corpus, in bytes
+  * @param  seed        (uint64_t) random seed, so runs can be repeated
+  * @retval (char*)     NUL-terminated corpus of exactly size bytes, to be
+  *                     freed with free(), or NULL if out of memory
+  * @ingroup BinTex
+  *
+  * Lines are never split: the end of the corpus is padded with newlines
+  * when the next line would not fit.  The corpus has no ';' and no NUL, so
+  * every API parses it to the end.
+  */
+char* corpus_make(int kind, size_t size, uint64_t seed);
+
+
+
+/** @brief  Parse a size argument, such as 100, 64K, 16M or 1G (powers of 1000)
+  * @param  arg         (const char*) size argument
+  * @retval (size_t)    size in bytes, or 0 if arg is invalid
+  * @ingroup BinTex
+  */
+size_t bench_size(const char* arg);
+
+
+
+/** @brief  Monotonic time in nanoseconds
+  * @retval (uint64_t)
+  * @ingroup BinTex
+  */
+uint64_t bench_ns(void);
+
+#endif
@@ -0,0 +1,295 @@
+/*  Copyright 2010-2018, JP Norair
+  *
+  * Licensed under the OpenTag License, Version 1.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  * http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  */
+
+/**
+  * @file       bench/corpus.c
+  * @author     JP Norair
+  * @version    V1.1
+  * @date       27 Jun 2018
+  * @brief      Synthetic BinTex corpora for the benchmarks
+  * @ingroup    BinTex
+  *
+  * Each kind stresses one part of the parser:
+  *
+  * hex             hex blocks and x tokens
+  * dec             decimal blocks and d tokens, with and without type codes
+  * ascii           strings, with some escapes
+  * comment         mostly comment lines, with a small hex block now and then
+  * mixed           a random choice of all of the above, and b tokens
+  ******************************************************************************
+  */
+
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Longest line written by any of the line generators
+#define CORPUS_LINEMAX  512
+
+const char* const corpus_names[CORPUS_max] = {
+    "hex", "dec", "ascii", "comment", "mixed"
+};
+
+static const char hexdigits[] = "0123456789ABCDEFabcdef";
+
+
+static uint64_t sub_rand(uint64_t* rng);
+static size_t sub_range(uint64_t* rng, size_t lo, size_t hi);
+static size_t sub_line(int kind, char* line, uint64_t* rng);
+static size_t sub_hexline(char* line, uint64_t* rng);
+static size_t sub_decline(char* line, uint64_t* rng);
+static size_t sub_asciiline(char* line, uint64_t* rng);
+static size_t sub_commentline(char* line, uint64_t* rng);
+static size_t sub_binline(char* line, uint64_t* rng);
+
+
+
+
+int corpus_find(const char* name) {
+    int i;
+
+    for (i=0; i<CORPUS_max; i++) {
+        if (strcmp(name, corpus_names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+char* corpus_make(int kind, size_t size, uint64_t seed) {
+    char        line[CORPUS_LINEMAX];
+    char*       corpus;
+    size_t      pos = 0;
+    uint64_t    rng = seed | 1;
+
+    corpus = malloc(size + 1);
+    if (corpus == NULL) {
+        return NULL;
+    }
+
+    while (1) {
+        size_t len = sub_line(kind, line, &rng);
+        if ((pos + len) > size) {
+            break;
+        }
+        memcpy(&corpus[pos], line, len);
+        pos += len;
+    }
+
+    memset(&corpus[pos], '\n', size - pos);
+    corpus[size] = 0;
+    return corpus;
+}
+
+
+size_t bench_size(const char* arg) {
+    char*   end;
+    size_t  size;
+
+    size = (size_t)strtoull(arg, &end, 10);
+    switch (*end) {
+        case 'k':
+        case 'K':   size *= 1000;       end++;  break;
+        case 'm':
+        case 'M':   size *= 1000000;    end++;  break;
+        case 'g':
+        case 'G':   size *= 1000000000; end++;  break;
+        default:    break;
+    }
+    if ((*end == 'B') || (*end == 'b')) {
+        end++;
+    }
+    return (*end == 0) ? size : 0;
+}
+
+
+uint64_t bench_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+
+
+
+
+/// xorshift64*, which is plenty for test data
+static uint64_t sub_rand(uint64_t* rng) {
+    *rng ^= *rng >> 12;
+    *rng ^= *rng << 25;
+    *rng ^= *rng >> 27;
+    return *rng * 0x2545F4914F6CDD1DULL;
+}
+
+static size_t sub_range(uint64_t* rng, size_t lo, size_t hi) {
+    return lo + (size_t)(sub_rand(rng) % (hi - lo + 1));
+}
+
+
+static size_t sub_line(int kind, char* line, uint64_t* rng) {
+    switch (kind) {
+        case CORPUS_hex:        return sub_hexline(line, rng);
+        case CORPUS_dec:        return sub_decline(line, rng);
+        case CORPUS_ascii:      return sub_asciiline(line, rng);
+
+        case CORPUS_comment:    if (sub_range(rng, 0, 4) != 0) {
+                                    return sub_commentline(line, rng);
+                                }
+                                memcpy(line, "[0102 0304]\n", 12);
+                                return 12;
+
+        default:                switch (sub_range(rng, 0, 4)) {
+                                    case 0:     return sub_hexline(line, rng);
+                                    case 1:     return sub_decline(line, rng);
+                                    case 2:     return sub_asciiline(line, rng);
+                                    case 3:     return sub_commentline(line, rng);
+                                    default:    return sub_binline(line, rng);
+                                }
+    }
+}
+
+
+/// A hex block of 1 to 4 groups, or an x token, of up to 64 digits each
+static size_t sub_hexline(char* line, uint64_t* rng) {
+    char*   p = line;
+    size_t  groups;
+    size_t  i, j;
+
+    if (sub_range(rng, 0, 3) == 0) {
+        *p++    = 'x';
+        groups  = 1;
+    }
+    else {
+        *p++    = '[';
+        groups  = sub_range(rng, 1, 4);
+    }
+
+    for (i=0; i<groups; i++) {
+        size_t digits = 2 * sub_range(rng, 1, 32);
+        for (j=0; j<digits; j++) {
+            *p++ = hexdigits[sub_rand(rng) % (sizeof(hexdigits)-1)];
+        }
+        *p++ = ' ';
+    }
+
+    if (line[0] == '[') {
+        p[-1] = ']';
+    }
+    else {
+        p--;
+    }
+    *p++ = '\n';
+    return p - line;
+}
+
+
+/// A decimal block of 1 to 8 numbers, or a d token, which all fit their types
+static size_t sub_decline(char* line, uint64_t* rng) {
+    static const char* const codes[] = { "", "", "s", "l", "ul" };
+    char*   p = line;
+    size_t  numbers;
+    size_t  i;
+
+    if (sub_range(rng, 0, 3) == 0) {
+        *p++    = 'd';
+        numbers = 1;
+    }
+    else {
+        *p++    = '(';
+        numbers = sub_range(rng, 1, 8);
+    }
+
+    for (i=0; i<numbers; i++) {
+        const char* code    = codes[sub_range(rng, 0, 4)];
+        long        number  = (long)sub_range(rng, 0, 65535) - 32768;
+
+        if (code[0] == 'u') {
+            number = labs(number);
+        }
+        else if (code[0] == 's') {
+            number /= 2;
+        }
+        p += sprintf(p, "%ld%s ", number, code);
+    }
+
+    if (line[0] == '(') {
+        p[-1] = ')';
+    }
+    else {
+        p--;
+    }
+    *p++ = '\n';
+    return p - line;
+}
+
+
+/// A string of 16 to 120 printable characters, with an escape now and then
+static size_t sub_asciiline(char* line, uint64_t* rng) {
+    static const char escapes[] = "ntr0\\\"";
+    char*   p = line;
+    size_t  chars;
+    size_t  i;
+
+    *p++    = '"';
+    chars   = sub_range(rng, 16, 120);
+    for (i=0; i<chars; i++) {
+        if (sub_range(rng, 0, 31) == 0) {
+            *p++ = '\\';
+            *p++ = escapes[sub_rand(rng) % (sizeof(escapes)-1)];
+        }
+        else {
+            char c = (char)sub_range(rng, ' ', '~');
+            *p++ = ((c == '"') || (c == '\\')) ? ' ' : c;
+        }
+    }
+    *p++ = '"';
+    *p++ = '\n';
+    return p - line;
+}
+
+
+/// A comment of 20 to 100 printable characters
+static size_t sub_commentline(char* line, uint64_t* rng) {
+    char*   p = line;
+    size_t  chars;
+    size_t  i;
+
+    *p++    = '#';
+    chars   = sub_range(rng, 20, 100);
+    for (i=0; i<chars; i++) {
+        *p++ = (char)sub_range(rng, ' ', '~');
+    }
+    *p++ = '\n';
+    return p - line;
+}
+
+
+/// A b token of 8 to 32 binary digits
+static size_t sub_binline(char* line, uint64_t* rng) {
+    char*   p = line;
+    size_t  digits;
+    size_t  i;
+
+    *p++    = 'b';
+    digits  = sub_range(rng, 8, 32);
+    for (i=0; i<digits; i++) {
+        *p++ = (char)('0' + (sub_rand(rng) & 1));
+    }
+    *p++ = '\n';
+    return p - line;
+}
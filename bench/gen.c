@@ -0,0 +1,74 @@
+/*  Copyright 2010-2018, JP Norair
+  *
+  * Licensed under the OpenTag License, Version 1.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  * http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  */
+
+/**
+  * @file       bench/gen.c
+  * @author     JP Norair
+  * @version    V1.1
+  * @date       27 Jun 2018
+  * @brief      Writes a synthetic BinTex corpus to a file or stdout
+  * @ingroup    BinTex
+  *
+  * Usage: bintex_gen kind size [seed] [file]
+  *
+  * The corpus is the same one the benchmarks parse for the same kind, size
+  * and seed, so a slow case can be saved and looked at.
+  ******************************************************************************
+  */
+
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+int main(int argc, char** argv) {
+    FILE*       out     = stdout;
+    uint64_t    seed    = 1;
+    char*       corpus;
+    size_t      size;
+    int         kind;
+
+    if ((argc < 3) || ((kind = corpus_find(argv[1])) < 0) || ((size = bench_size(argv[2])) == 0)) {
+        fprintf(stderr, "Usage: %s hex|dec|ascii|comment|mixed size [seed] [file]\n", argv[0]);
+        return 1;
+    }
+    if (argc > 3) {
+        seed = strtoull(argv[3], NULL, 0);
+    }
+    if (argc > 4) {
+        out = fopen(argv[4], "w");
+        if (out == NULL) {
+            fprintf(stderr, "Error, could not open file: %s\n", argv[4]);
+            return 1;
+        }
+    }
+
+    corpus = corpus_make(kind, size, seed);
+    if (corpus == NULL) {
+        fprintf(stderr, "Error, out of memory\n");
+        return 1;
+    }
+    if (fwrite(corpus, 1, size, out) != size) {
+        fprintf(stderr, "Error, could not write corpus\n");
+        return 1;
+    }
+
+    free(corpus);
+    if (out != stdout) {
+        fclose(out);
+    }
+    return 0;
+}
@@ -0,0 +1,391 @@
+/*  Copyright 2010-2018, JP Norair
+  *
+  * Licensed under the OpenTag License, Version 1.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  * http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  */
+
+/**
+  * @file       bench/latency.c
+  * @author     JP Norair
+  * @version    V1.1
+  * @date       27 Jun 2018
+  * @brief      Latency of parsing single short commands
+  * @ingroup    BinTex
+  *
+  * Usage: bintex_latency [-f file] [-a api,...] [-n warm] [-c cold] [-H]
+  *
+  * Each call parses one command, such as a line of test_1.txt, and is timed
+  * on its own: with the TSC on x86, else with clock_gettime().  Commands are
+  * taken in turn from the built-in set, or from the lines of a file.
+  *
+  * warm            calls back to back, so code and data are in cache
+  * cold            the caches are flushed by walking a large buffer before
+  *                 each call, which is much slower, so there are fewer
+  *
+  * Percentiles are reported in ns, after the timer's own median overhead is
+  * taken off.  -H also prints a histogram with power-of-2 buckets.
+  ******************************************************************************
+  */
+
+#include "../bintex.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#   include <x86intrin.h>
+#   define LAT_TSC      1
+#endif
+
+// Bigger than the last level cache of any machine this runs on
+#ifndef LAT_FLUSHSIZE
+#   define LAT_FLUSHSIZE    (64*1024*1024)
+#endif
+
+#define LAT_MAXCMDS     256
+#define LAT_CMDLEN      512
+
+typedef struct {
+    unsigned char*  cmd[LAT_MAXCMDS];
+    size_t          len[LAT_MAXCMDS];
+    size_t          count;
+    uint8_t         out[LAT_CMDLEN];
+    bintex_ctx      ctx;
+} lat_job;
+
+typedef struct {
+    const char*     name;
+    ssize_t         (*run)(lat_job* job, size_t i);
+} lat_api;
+
+
+static ssize_t sub_ss(lat_job* job, size_t i);
+static ssize_t sub_sn(lat_job* job, size_t i);
+static ssize_t sub_sn_r(lat_job* job, size_t i);
+static ssize_t sub_iter_sq(lat_job* job, size_t i);
+static ssize_t sub_iter_snq(lat_job* job, size_t i);
+static uint64_t sub_ticks(void);
+static double sub_calibrate(void);
+static int sub_loadfile(lat_job* job, const char* path);
+static void sub_flush(volatile uint8_t* buffer);
+static void sub_measure(lat_job* job, const lat_api* api, uint32_t* samples, size_t n, uint8_t* flush);
+static void sub_report(const char* api, const char* mode, uint32_t* samples, size_t n, int histogram);
+static int sub_cmp(const void* a, const void* b);
+static int sub_listed(const char* list, const char* name);
+
+static const lat_api apis[] = {
+    { "bintex_ss",          &sub_ss },
+    { "bintex_sn",          &sub_sn },
+    { "bintex_sn_r",        &sub_sn_r },
+    { "bintex_iter_sq",     &sub_iter_sq },
+    { "bintex_iter_snq",    &sub_iter_snq },
+};
+
+#define LAT_APIS    (sizeof(apis) / sizeof(lat_api))
+
+static const char* const commands[] = {
+    "[22 33 44 55] (32 64 128) \"abcd\"",
+    "[00112233445566778899112233445566]",
+    "x0102",
+    "(1 2 3)",
+    "\"ping\"",
+    "[0A 01] d300 b1010",
+};
+
+static double   ns_per_tick;
+static uint32_t overhead;
+
+
+
+
+int main(int argc, char** argv) {
+    const char* names   = NULL;
+    const char* path    = NULL;
+    size_t      warm    = 1000000;
+    size_t      cold    = 2000;
+    int         histogram = 0;
+    uint32_t*   samples;
+    uint8_t*    flush;
+    lat_job     job;
+    size_t      i;
+    int         opt;
+
+    while ((opt = getopt(argc, argv, "f:a:n:c:H")) != -1) {
+        switch (opt) {
+            case 'f':   path    = optarg;                           break;
+            case 'a':   names   = optarg;                           break;
+            case 'n':   warm    = (size_t)strtoull(optarg, NULL, 0); break;
+            case 'c':   cold    = (size_t)strtoull(optarg, NULL, 0); break;
+            case 'H':   histogram = 1;                              break;
+            default:    fprintf(stderr, "Usage: %s [-f file] [-a api,...] [-n warm] [-c cold] [-H]\n", argv[0]);
+                        return 1;
+        }
+    }
+
+    memset(&job, 0, sizeof(job));
+    if (path != NULL) {
+        if (sub_loadfile(&job, path) != 0) {
+            fprintf(stderr, "Error, no commands in file: %s\n", path);
+            return 1;
+        }
+    }
+    else {
+        for (i=0; i<(sizeof(commands)/sizeof(commands[0])); i++) {
+            job.cmd[i] = (unsigned char*)strdup(commands[i]);
+            job.len[i] = strlen(commands[i]);
+        }
+        job.count = i;
+    }
+    bintex_ctx_init(&job.ctx);
+
+    samples = malloc(((warm > cold) ? warm : cold) * sizeof(uint32_t));
+    flush   = malloc(LAT_FLUSHSIZE);
+    if ((samples == NULL) || (flush == NULL)) {
+        fprintf(stderr, "Error, out of memory\n");
+        return 1;
+    }
+    memset(flush, 1, LAT_FLUSHSIZE);
+
+    ns_per_tick = sub_calibrate();
+    printf("%zu commands, timer %s, overhead %.1f ns\n\n", job.count,
+#           ifdef LAT_TSC
+            "rdtsc",
+#           else
+            "clock_gettime",
+#           endif
+            overhead * ns_per_tick);
+    printf("%-16s %-5s %9s %9s %9s %9s %9s %9s\n", "api", "cache", "min", "p50", "p90", "p99", "p999", "max");
+
+    for (i=0; i<LAT_APIS; i++) {
+        if ((names != NULL) && !sub_listed(names, apis[i].name)) {
+            continue;
+        }
+        if (warm != 0) {
+            sub_measure(&job, &apis[i], samples, warm, NULL);
+            sub_report(apis[i].name, "warm", samples, warm, histogram);
+        }
+        if (cold != 0) {
+            sub_measure(&job, &apis[i], samples, cold, flush);
+            sub_report(apis[i].name, "cold", samples, cold, histogram);
+        }
+    }
+
+    for (i=0; i<job.count; i++) {
+        free(job.cmd[i]);
+    }
+    free(samples);
+    free(flush);
+    return 0;
+}
+
+
+
+
+static uint64_t sub_ticks(void) {
+#   ifdef LAT_TSC
+    uint64_t t;
+    _mm_lfence();
+    t = __rdtsc();
+    _mm_lfence();
+    return t;
+#   else
+    return bench_ns();
+#   endif
+}
+
+
+/// ns per tick, from the TSC and the monotonic clock over 50 ms, and the
+/// median cost of reading the timer twice
+static double sub_calibrate(void) {
+    uint32_t    pairs[1001];
+    uint64_t    t0, t1, n0, n1;
+    double      scale;
+    int         i;
+
+#   ifdef LAT_TSC
+    n0 = bench_ns();
+    t0 = sub_ticks();
+    do {
+        n1 = bench_ns();
+    } while ((n1 - n0) < 50000000ULL);
+    t1      = sub_ticks();
+    scale   = (double)(n1 - n0) / (double)(t1 - t0);
+#   else
+    scale   = 1.0;
+#   endif
+
+    for (i=0; i<1001; i++) {
+        t0          = sub_ticks();
+        t1          = sub_ticks();
+        pairs[i]    = (uint32_t)(t1 - t0);
+    }
+    qsort(pairs, 1001, sizeof(uint32_t), &sub_cmp);
+    overhead = pairs[500];
+    return scale;
+}
+
+
+/// Lines of the file are commands.  Empty lines and comment lines are skipped.
+static int sub_loadfile(lat_job* job, const char* path) {
+    char    line[LAT_CMDLEN];
+    FILE*   fp;
+
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        return -1;
+    }
+    while ((job->count < LAT_MAXCMDS) && (fgets(line, sizeof(line), fp) != NULL)) {
+        size_t len = strcspn(line, "\r\n");
+        line[len] = 0;
+        if ((len == 0) || (line[0] == '#')) {
+            continue;
+        }
+        job->cmd[job->count] = (unsigned char*)strdup(line);
+        job->len[job->count] = len;
+        job->count++;
+    }
+    fclose(fp);
+    return (job->count == 0) ? -1 : 0;
+}
+
+
+static void sub_flush(volatile uint8_t* buffer) {
+    size_t i;
+
+    for (i=0; i<LAT_FLUSHSIZE; i+=64) {
+        buffer[i]++;
+    }
+}
+
+
+static void sub_measure(lat_job* job, const lat_api* api, uint32_t* samples, size_t n, uint8_t* flush) {
+    size_t i;
+
+    // Untimed pass, so the first warm samples are not cold
+    for (i=0; i<job->count; i++) {
+        api->run(job, i);
+    }
+
+    for (i=0; i<n; i++) {
+        uint64_t    t0, t1;
+        size_t      cmd = i % job->count;
+
+        if (flush != NULL) {
+            sub_flush(flush);
+        }
+        t0 = sub_ticks();
+        api->run(job, cmd);
+        t1 = sub_ticks();
+
+        t1 -= t0;
+        t1  = (t1 > overhead) ? (t1 - overhead) : 0;
+        samples[i] = (t1 > UINT32_MAX) ? UINT32_MAX : (uint32_t)t1;
+    }
+}
+
+
+static void sub_report(const char* api, const char* mode, uint32_t* samples, size_t n, int histogram) {
+    static const double pct[] = { 0.50, 0.90, 0.99, 0.999 };
+    size_t  i;
+
+    qsort(samples, n, sizeof(uint32_t), &sub_cmp);
+
+    printf("%-16s %-5s %9.1f", api, mode, samples[0] * ns_per_tick);
+    for (i=0; i<4; i++) {
+        printf(" %9.1f", samples[(size_t)(pct[i] * (double)(n - 1))] * ns_per_tick);
+    }
+    printf(" %9.1f\n", samples[n-1] * ns_per_tick);
+
+    if (histogram) {
+        size_t  buckets[33] = {0};
+        size_t  top = 0;
+        int     b;
+
+        for (i=0; i<n; i++) {
+            uint64_t ns = (uint64_t)(samples[i] * ns_per_tick);
+            for (b=0; (b < 32) && ((1ULL << b) <= ns); b++);
+            buckets[b]++;
+        }
+        for (b=0; b<33; b++) {
+            top = (buckets[b] > top) ? buckets[b] : top;
+        }
+        for (b=0; b<33; b++) {
+            if (buckets[b] != 0) {
+                int bar = (int)((buckets[b] * 50) / top);
+                printf("    < %10llu ns %10zu  %.*s\n", 1ULL << b, buckets[b], (bar == 0) ? 1 : bar,
+                        "##################################################");
+            }
+        }
+        putchar('\n');
+    }
+}
+
+
+static int sub_cmp(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+
+/// Whether name is one of the comma separated names in list
+static int sub_listed(const char* list, const char* name) {
+    size_t len = strlen(name);
+
+    while (*list != 0) {
+        size_t n = strcspn(list, ",");
+        if ((n == len) && (strncmp(list, name, len) == 0)) {
+            return 1;
+        }
+        list += n + (list[n] == ',');
+    }
+    return 0;
+}
+
+
+
+
+static ssize_t sub_ss(lat_job* job, size_t i) {
+    return bintex_ss(job->cmd[i], job->out, sizeof(job->out));
+}
+
+static ssize_t sub_sn(lat_job* job, size_t i) {
+    return bintex_sn(job->cmd[i], job->len[i], job->out, sizeof(job->out));
+}
+
+/// A context kept between calls, as a long running program would
+static ssize_t sub_sn_r(lat_job* job, size_t i) {
+    return bintex_sn_r(&job->ctx, job->cmd[i], job->len[i], job->out, sizeof(job->out));
+}
+
+static ssize_t sub_iter_sq(lat_job* job, size_t i) {
+    unsigned char*  cursor = job->cmd[i];
+    bintex_q        q;
+    ssize_t         rc;
+
+    bintex_q_init(&q, job->out, sizeof(job->out));
+    while ((rc = bintex_iter_sq(&cursor, &q, 0)) >= 0);
+    return rc;
+}
+
+static ssize_t sub_iter_snq(lat_job* job, size_t i) {
+    const uint8_t*  cursor  = job->cmd[i];
+    size_t          left    = job->len[i];
+    bintex_q        q;
+    ssize_t         rc;
+
+    bintex_q_init(&q, job->out, sizeof(job->out));
+    while ((rc = bintex_iter_snq(&cursor, &left, &q)) >= 0);
+    return rc;
+}
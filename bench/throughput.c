@@ -0,0 +1,236 @@
+/*  Copyright 2010-2018, JP Norair
+  *
+  * Licensed under the OpenTag License, Version 1.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  * http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  */
+
+/**
+  * @file       bench/throughput.c
+  * @author     JP Norair
+  * @version    V1.1
+  * @date       27 Jun 2018
+  * @brief      Throughput of the BinTex parsing APIs over synthetic corpora
+  * @ingroup    BinTex
+  *
+  * Usage: bintex_throughput [-k kind,...] [-s size,...] [-t seconds] [-S seed]
+  *
+  * Each API parses each corpus repeatedly for at least the given time, and
+  * the mean is reported as MB/s of input and ns per expression.  An
+  * expression is one non-negative return of bintex_iter_snq(), so the count
+  * is the same for every API.  Every API must give the same output length as
+  * bintex_sn(), or the row is marked as a mismatch.
+  ******************************************************************************
+  */
+
+#include "../bintex.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct {
+    unsigned char*  in;
+    size_t          in_len;
+    unsigned char*  out;
+    size_t          out_len;
+    FILE*           file;
+} bench_job;
+
+typedef struct {
+    const char*     name;
+    ssize_t         (*run)(bench_job* job);
+} bench_api;
+
+
+static ssize_t sub_ss(bench_job* job);
+static ssize_t sub_sn(bench_job* job);
+static ssize_t sub_fs(bench_job* job);
+static ssize_t sub_iter_sq(bench_job* job);
+static ssize_t sub_iter_snq(bench_job* job);
+static size_t sub_count(bench_job* job);
+static int sub_bench(int kind, size_t size, double seconds, uint64_t seed);
+
+static const bench_api apis[] = {
+    { "bintex_ss",          &sub_ss },
+    { "bintex_sn",          &sub_sn },
+    { "bintex_fs",          &sub_fs },
+    { "bintex_iter_sq",     &sub_iter_sq },
+    { "bintex_iter_snq",    &sub_iter_snq },
+};
+
+#define BENCH_APIS  (sizeof(apis) / sizeof(bench_api))
+
+
+
+
+int main(int argc, char** argv) {
+    const char* kinds   = "hex,dec,ascii,comment,mixed";
+    const char* sizes   = "100,10K,1M,16M";
+    double      seconds = 0.25;
+    uint64_t    seed    = 1;
+    char*       klist;
+    char*       kname;
+    char*       ksave;
+    int         rc      = 0;
+    int         opt;
+
+    while ((opt = getopt(argc, argv, "k:s:t:S:")) != -1) {
+        switch (opt) {
+            case 'k':   kinds   = optarg;                       break;
+            case 's':   sizes   = optarg;                       break;
+            case 't':   seconds = atof(optarg);                 break;
+            case 'S':   seed    = strtoull(optarg, NULL, 0);    break;
+            default:    fprintf(stderr, "Usage: %s [-k kind,...] [-s size,...] [-t seconds] [-S seed]\n", argv[0]);
+                        return 1;
+        }
+    }
+
+    printf("%-8s %12s  %-16s %10s %10s\n", "corpus", "bytes", "api", "MB/s", "ns/expr");
+
+    klist = strdup(kinds);
+    for (kname=strtok_r(klist, ",", &ksave); kname!=NULL; kname=strtok_r(NULL, ",", &ksave)) {
+        char*   slist;
+        char*   sname;
+        char*   ssave;
+        int     kind = corpus_find(kname);
+
+        if (kind < 0) {
+            fprintf(stderr, "Error, unknown corpus: %s\n", kname);
+            rc = 1;
+            continue;
+        }
+
+        slist = strdup(sizes);
+        for (sname=strtok_r(slist, ",", &ssave); sname!=NULL; sname=strtok_r(NULL, ",", &ssave)) {
+            size_t size = bench_size(sname);
+            if (size == 0) {
+                fprintf(stderr, "Error, invalid size: %s\n", sname);
+                rc = 1;
+                continue;
+            }
+            rc |= sub_bench(kind, size, seconds, seed);
+        }
+        free(slist);
+    }
+    free(klist);
+
+    return rc;
+}
+
+
+
+
+static int sub_bench(int kind, size_t size, double seconds, uint64_t seed) {
+    bench_job   job;
+    ssize_t     expect;
+    size_t      exprs;
+    size_t      i;
+    int         rc = 0;
+
+    job.in      = (unsigned char*)corpus_make(kind, size, seed);
+    job.in_len  = size;
+    job.out_len = size + 64;
+    job.out     = malloc(job.out_len);
+    job.file    = tmpfile();
+    if ((job.in == NULL) || (job.out == NULL) || (job.file == NULL)) {
+        fprintf(stderr, "Error, could not set up %zu byte %s corpus\n", size, corpus_names[kind]);
+        free(job.in);
+        free(job.out);
+        return 1;
+    }
+    fwrite(job.in, 1, size, job.file);
+    fflush(job.file);
+
+    exprs   = sub_count(&job);
+    expect  = sub_sn(&job);
+
+    for (i=0; i<BENCH_APIS; i++) {
+        uint64_t    limit   = (uint64_t)(seconds * 1e9);
+        uint64_t    start;
+        uint64_t    elapsed;
+        size_t      runs    = 0;
+        ssize_t     out;
+
+        // One untimed run, which also checks the output
+        out     = apis[i].run(&job);
+        start   = bench_ns();
+        do {
+            apis[i].run(&job);
+            runs++;
+            elapsed = bench_ns() - start;
+        } while (elapsed < limit);
+
+        printf("%-8s %12zu  %-16s %10.1f %10.1f%s\n",
+                corpus_names[kind], size, apis[i].name,
+                ((double)size * runs * 1e3) / (double)elapsed,
+                (double)elapsed / ((double)runs * (exprs ? exprs : 1)),
+                (out == expect) ? "" : "  MISMATCH");
+        if (out != expect) {
+            rc = 1;
+        }
+    }
+
+    fclose(job.file);
+    free(job.in);
+    free(job.out);
+    return rc;
+}
+
+
+static size_t sub_count(bench_job* job) {
+    const uint8_t*  cursor  = job->in;
+    size_t          left    = job->in_len;
+    size_t          exprs   = 0;
+    bintex_q        q;
+
+    bintex_q_init(&q, job->out, job->out_len);
+    while (bintex_iter_snq(&cursor, &left, &q) >= 0) {
+        exprs++;
+    }
+    return exprs;
+}
+
+
+static ssize_t sub_ss(bench_job* job) {
+    return bintex_ss(job->in, job->out, job->out_len);
+}
+
+static ssize_t sub_sn(bench_job* job) {
+    return bintex_sn(job->in, job->in_len, job->out, job->out_len);
+}
+
+static ssize_t sub_fs(bench_job* job) {
+    rewind(job->file);
+    return bintex_fs(job->file, job->out, job->out_len);
+}
+
+static ssize_t sub_iter_sq(bench_job* job) {
+    unsigned char*  cursor = job->in;
+    bintex_q        q;
+    ssize_t         rc;
+
+    bintex_q_init(&q, job->out, job->out_len);
+    while ((rc = bintex_iter_sq(&cursor, &q, 0)) >= 0);
+    return (rc == BINTEX_EOF) ? (ssize_t)(q.putcursor - q.front) : rc;
+}
+
+static ssize_t sub_iter_snq(bench_job* job) {
+    const uint8_t*  cursor  = job->in;
+    size_t          left    = job->in_len;
+    bintex_q        q;
+    ssize_t         rc;
+
+    bintex_q_init(&q, job->out, job->out_len);
+    while ((rc = bintex_iter_snq(&cursor, &left, &q)) >= 0);
+    return (rc == BINTEX_EOF) ? (ssize_t)(q.putcursor - q.front) : rc;
+}
@@ -25,13 +25,76 @@
   */
 
 #include "bintex.h"
+#include <errno.h>
+#include <stdlib.h>
 #include <string.h>
 
+#if defined(__unix__) || defined(__APPLE__)
+#   include <fcntl.h>
+#   include <unistd.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#endif
 
-#define IS_WHITESPACE(VAL)  ((VAL==' ')||(VAL=='\r')||(VAL=='\n')||(VAL=='\t'))
-#define IS_HEXVAL(VAL)      ((((VAL)>='0') && ((VAL)<='9')) || (((VAL)>='a') && ((VAL)<='f')) || (((VAL)>='A') && ((VAL)<='F')))
-#define IS_DECVAL(VAL)      (((VAL)>='0') && ((VAL)<='9'))
-#define IS_BINVAL(VAL)      (((VAL)>='0') && ((VAL)<='1'))
+// Read size of the buffered file reader
+#ifndef BINTEX_BLOCKSIZE
+#   define BINTEX_BLOCKSIZE     65536
+#endif
+
+// Parser counters, see bintex_stats_get().  Ticks are the TSC where there is
+// one, since clock_gettime() would cost more than a short expression.
+#ifdef __BINTEX_STATS__
+#   if defined(__x86_64__) || defined(__i386__)
+#       include <x86intrin.h>
+#       define STATS_TICKS()    __rdtsc()
+#   else
+#       include <time.h>
+#       define STATS_TICKS()    sub_statsns()
+#   endif
+#endif
+
+// Static tracepoints of the "bintex" provider, for perf and bpftrace.  Each is
+// a single nop until a tracer attaches to it.
+//
+// expr_start(ctx)                          before each expression
+// expr_end(ctx, type, rc, in_bytes)        after it, with its Data_type
+// header_error(ctx, c)                     at a character that starts nothing
+// q_reserve(q, need)                       before each write to the output
+// q_full(q, need)                          when there is no room for it
+#ifdef __BINTEX_SDT__
+#   if defined(__has_include)
+#       if !__has_include(<sys/sdt.h>)
+#           error "__BINTEX_SDT__ needs <sys/sdt.h>, from systemtap-sdt-dev or systemtap-sdt-devel"
+#       endif
+#   endif
+#   include <sys/sdt.h>
+#   define PROBE1(NAME, A)              DTRACE_PROBE1(bintex, NAME, A)
+#   define PROBE2(NAME, A, B)           DTRACE_PROBE2(bintex, NAME, A, B)
+#   define PROBE4(NAME, A, B, C, D)     DTRACE_PROBE4(bintex, NAME, A, B, C, D)
+#else
+#   define PROBE1(NAME, A)              do { } while (0)
+#   define PROBE2(NAME, A, B)           do { } while (0)
+#   define PROBE4(NAME, A, B, C, D)     do { } while (0)
+#endif
+
+// SSE2 is the baseline on x86-64.  AVX2 is used when the CPU supports it.
+#if !defined(__BINTEX_NOSIMD__) && (defined(__SSE2__) || defined(_M_X64))
+#   define BINTEX_SSE2
+#   include <emmintrin.h>
+#   if defined(__AVX2__)
+#       define BINTEX_AVX2
+#       define HAS_AVX2()   1
+#       include <immintrin.h>
+#   elif defined(__GNUC__)
+#       define BINTEX_AVX2
+#       define BINTEX_AVX2_TARGET   __attribute__((target("avx2")))
+#       define HAS_AVX2()   __builtin_cpu_supports("avx2")
+#       include <immintrin.h>
+#   endif
+#endif
+#ifndef BINTEX_AVX2_TARGET
+#   define BINTEX_AVX2_TARGET
+#endif
 
 
 typedef enum {
@@ -44,52 +107,162 @@ typedef enum {
     DATA_hexnum,
     DATA_hexblock,
     DATA_decnum,
-    DATA_decblock
+    DATA_decblock,
+    DATA_slot
 } Data_type;
 
-
-/// Global Variables.  
-///@todo Should be moved into object.
-static int (*sub_getc)(void* stream);
-static int (*sub_validatehex)(void* stream);
-static int (*sub_validatedec)(void* stream);
+/// Returned by sub_parsestream() at a '%' while compiling a template
+#define BINTEX_SLOT         (-5)
 
 
-static int sub_buffergetc(void* stream);
-static int sub_filegetc(void* stream);
-static int sub_buffer_validatehex(void* stream);
-static int sub_file_validatehex(void* stream);
-static int sub_buffer_validatedec(void* stream);
-static int sub_file_validatedec(void* stream);
+/** Character table.  Each of the 256 byte values has an entry with:
+  * bits 0-3        nibble value of a hex digit, else 0
+  * bits 4-8        class bits: CH_WS, CH_HEX, CH_DEC, CH_BIN, CH_DECTOK
+  * bits 12-15      Data_type of an expression starting with the byte, or 
+  *                 CH_SKIP for the characters skipped before an expression
+  *
+  * Readers return EOF as -1, which indexes the entry of 0xFF as (uint8_t)-1.
+  * That entry has no class, so EOF ends a token like any other invalid byte,
+  * and parsers test for EOF before the header type.  The entries are made
+  * at compile time from the character tests below.
+  */
+#define CH_WS       0x010
+#define CH_HEX      0x020
+#define CH_DEC      0x040
+#define CH_BIN      0x080
+#define CH_DECTOK   0x100
+#define CH_SKIP     15
+
+#define CHR_WS(C)       (((C)==' ') || ((C)=='\r') || ((C)=='\n') || ((C)=='\t'))
+#define CHR_DEC(C)      (((C)>='0') && ((C)<='9'))
+#define CHR_HEX(C)      (CHR_DEC(C) || (((C)>='a') && ((C)<='f')) || (((C)>='A') && ((C)<='F')))
+#define CHR_BIN(C)      (((C)=='0') || ((C)=='1'))
+#define CHR_DECTOK(C)   (CHR_DEC(C) || ((C)=='-') || ((C)=='u') || ((C)=='c') || ((C)=='s') || ((C)=='l'))
+#define CHR_NIBBLE(C)   (CHR_DEC(C) ? ((C)-'0') : CHR_HEX(C) ? (((C)|0x20)-'a'+10) : 0)
+#define CHR_HEADER(C)   ((CHR_WS(C) || ((C)=='0')) ? CH_SKIP :  \
+                         ((C)=='#') ? DATA_comment :            \
+                         ((C)=='"') ? DATA_ascii :              \
+                         ((C)=='b') ? DATA_binnum :             \
+                         ((C)=='x') ? DATA_hexnum :             \
+                         ((C)=='[') ? DATA_hexblock :           \
+                         ((C)=='d') ? DATA_decnum :             \
+                         ((C)=='(') ? DATA_decblock :           \
+                         ((C)=='%') ? DATA_slot :               \
+                         ((C)==';') ? DATA_lineterm : DATA_error)
+
+#define CH_ENTRY(C)     (uint16_t)(CHR_NIBBLE(C) | (CHR_HEADER(C) << 12)   \
+                        | (CHR_WS(C) ? CH_WS : 0) | (CHR_HEX(C) ? CH_HEX : 0) | (CHR_DEC(C) ? CH_DEC : 0) \
+                        | (CHR_BIN(C) ? CH_BIN : 0) | (CHR_DECTOK(C) ? CH_DECTOK : 0))
+#define CH_ROW(N)       CH_ENTRY(N+0),  CH_ENTRY(N+1),  CH_ENTRY(N+2),  CH_ENTRY(N+3),  \
+                        CH_ENTRY(N+4),  CH_ENTRY(N+5),  CH_ENTRY(N+6),  CH_ENTRY(N+7),  \
+                        CH_ENTRY(N+8),  CH_ENTRY(N+9),  CH_ENTRY(N+10), CH_ENTRY(N+11), \
+                        CH_ENTRY(N+12), CH_ENTRY(N+13), CH_ENTRY(N+14), CH_ENTRY(N+15)
+
+static const uint16_t ch_table[256] = {
+    CH_ROW(0x00), CH_ROW(0x10), CH_ROW(0x20), CH_ROW(0x30),
+    CH_ROW(0x40), CH_ROW(0x50), CH_ROW(0x60), CH_ROW(0x70),
+    CH_ROW(0x80), CH_ROW(0x90), CH_ROW(0xA0), CH_ROW(0xB0),
+    CH_ROW(0xC0), CH_ROW(0xD0), CH_ROW(0xE0), CH_ROW(0xF0)
+};
+
+#define CH_CLASS(VAL, BITS) (ch_table[(uint8_t)(VAL)] & (BITS))
+#define CH_NIBBLE(VAL)      (ch_table[(uint8_t)(VAL)] & 0x0F)
+#define CH_HEADER(VAL)      (ch_table[(uint8_t)(VAL)] >> 12)
+
+#define IS_WHITESPACE(VAL)  CH_CLASS(VAL, CH_WS)
+#define IS_HEXVAL(VAL)      CH_CLASS(VAL, CH_HEX)
+#define IS_DECVAL(VAL)      CH_CLASS(VAL, CH_DEC)
+#define IS_BINVAL(VAL)      CH_CLASS(VAL, CH_BIN)
+#define IS_DECTOKEN(VAL)    CH_CLASS(VAL, CH_DECTOK)
+
+/// States of the push parser
+typedef enum {
+    PUSH_header = 0,
+    PUSH_comment,
+    PUSH_ascii,
+    PUSH_escape,
+    PUSH_binnum,
+    PUSH_hexnum,
+    PUSH_hexblock,
+    PUSH_decnum,
+    PUSH_decblock
+} Push_state;
+
+
+/// Input readers, bound into the parser context
+static int sub_buffergetc(bintex_ctx* ctx);
+static int sub_bufferngetc(bintex_ctx* ctx);
+static int sub_filegetc(bintex_ctx* ctx);
+static void sub_bindbuffer(bintex_ctx* ctx, const unsigned char* string, const unsigned char* end);
+static void sub_bindfile(bintex_ctx* ctx, FILE* file);
+static void sub_bindblock(bintex_ctx* ctx, FILE* file, int fd);
+static int sub_blockfill(bintex_ctx* ctx);
+static void sub_bindstream(bintex_ctx* ctx, FILE* file);
+static int sub_blockgetc(bintex_ctx* ctx);
+static ssize_t sub_parseall(bintex_ctx* ctx, unsigned char* stream_out, size_t size);
+static ssize_t sub_parseq(bintex_ctx* ctx, bintex_q* msg);
+
+static inline int sub_getc(bintex_ctx* ctx) {
+    return ctx->readc(ctx);
+}
 
 
-static int sub_parsestream(void* stream, bintex_q* msg);
-static Data_type sub_parse_header(void* stream);
-static int sub_passcomment(void* stream);
-static int sub_getascii(void* stream, bintex_q* msg);
-static int sub_gethexblock(void* stream, bintex_q* msg);
-static int sub_getdecblock(void* stream, bintex_q* msg);
-static int sub_gethexnum(int* status, void* stream, bintex_q* msg);
-static int sub_getbinnum(int* status, void* stream, bintex_q* msg);
+static ssize_t sub_parsestream(bintex_ctx* ctx, bintex_q* msg);
+static inline ssize_t sub_parseexpr(bintex_ctx* ctx, bintex_q* msg, Data_type* type);
+static Data_type sub_parse_header(bintex_ctx* ctx);
+static int sub_passcomment(bintex_ctx* ctx);
+static ssize_t sub_getascii(bintex_ctx* ctx, bintex_q* msg);
+static ssize_t sub_gethexblock(bintex_ctx* ctx, bintex_q* msg);
+static ssize_t sub_getdecblock(bintex_ctx* ctx, bintex_q* msg);
+static int sub_gethexnum(int* status, bintex_ctx* ctx, bintex_q* msg);
+static int sub_gethexnum_buf(int* status, bintex_ctx* ctx, bintex_q* msg);
+static int sub_getbinnum(int* status, bintex_ctx* ctx, bintex_q* msg);
 static char sub_char2hex(char input);
-static int sub_getdecnum(int* status, void* stream, bintex_q* msg);
-
-static int sub_bindigits(int* status, void* stream, char* buf, int limit);
-static int sub_hexdigits(int* status, void* stream, char* buf, int limit);
-static int sub_decdigits(int* status, void* stream, char* buf, int limit);
-
-
-static void q_init(bintex_q* q, uint8_t* buffer, uint16_t alloc);
+static int sub_getdecnum(int* status, bintex_ctx* ctx, bintex_q* msg);
+static int sub_escape(int next);
+static int sub_puthex(int* status, bintex_q* msg, const unsigned char* in, int digits);
+static int sub_putdec(int* status, bintex_q* msg, const char* buf, int digits);
+static int sub_putbin(int* status, bintex_q* msg, const char* buf, int digits);
+static int sub_pushstep(bintex_ctx* ctx);
+
+/// Structural index of buffered input, see sub_index64()
+typedef struct {
+    uint64_t    ws;
+    uint64_t    line;
+    uint64_t    str;
+} ch_index;
+
+static void sub_skipws(bintex_ctx* ctx);
+static void sub_skipline(bintex_ctx* ctx);
+static size_t sub_strrun(const unsigned char* in, size_t avail);
+
+static int sub_bindigits(int* status, bintex_ctx* ctx, char* buf, int limit);
+static int sub_hexdigits(int* status, bintex_ctx* ctx, char* buf, int limit);
+static int sub_decdigits(int* status, bintex_ctx* ctx, char* buf, int limit);
+
+static int sub_tplslot(bintex_ctx* ctx, bintex_q* frame, bintex_slot* slot);
+
+static size_t sub_emit(char* out, const uint8_t* in, size_t in_len, int flags);
+static size_t sub_emitascii(char* out, const uint8_t* in, size_t len);
+static size_t sub_emithex(char* out, const uint8_t* in, size_t len);
+static size_t sub_emitdec(char* out, const uint8_t* in, size_t len, int flags);
+
+
+static void q_init(bintex_q* q, uint8_t* buffer, size_t alloc);
+static inline int q_reserve(bintex_q* q, size_t need);
+static int q_discard(bintex_q* q, size_t need);
+static int q_grow(bintex_q* q, size_t need);
+static void* q_stdalloc(void* ud, void* ptr, size_t osize, size_t nsize);
 static void q_rebase(bintex_q *q, uint8_t* buffer);
 static void q_copy(bintex_q* q1, bintex_q* q2);
-static int16_t q_length(bintex_q* q);
-static int16_t q_span(bintex_q* q);
-static int16_t q_space(bintex_q* q);
+static size_t q_length(bintex_q* q);
+static size_t q_span(bintex_q* q);
+static size_t q_space(bintex_q* q);
 static void q_empty(bintex_q* q);
-static int16_t q_length(bintex_q* q);
-static int16_t q_span(bintex_q* q);
-static int16_t q_space(bintex_q* q);
-static uint8_t* q_start(bintex_q* q, int offset, uint16_t options);
+static size_t q_length(bintex_q* q);
+static size_t q_span(bintex_q* q);
+static size_t q_space(bintex_q* q);
+static uint8_t* q_start(bintex_q* q, size_t offset, uint16_t options);
 static uint8_t* q_markbyte(bintex_q* q, int shift);
 static void q_writebyte(bintex_q* q, uint8_t byte_in);
 static void q_writeshort(bintex_q* q, uint16_t short_in);
@@ -99,8 +272,8 @@ static uint8_t q_readbyte(bintex_q* q);
 static uint16_t q_readshort(bintex_q* q);
 static uint16_t q_readshort_be(bintex_q* q);
 static uint32_t q_readlong(bintex_q* q);
-static void q_writestring(bintex_q* q, uint8_t* string, int length);
-static void q_readstring(bintex_q* q, uint8_t* string, int length);
+static void q_writestring(bintex_q* q, uint8_t* string, size_t length);
+static void q_readstring(bintex_q* q, uint8_t* string, size_t length);
 
 
 
@@ -123,86 +296,483 @@ typedef union {
 
 
 
-int bintex_iter_fq(FILE* file, bintex_q* msg) {
-    sub_getc        = &sub_filegetc;
-    sub_validatehex = &sub_file_validatehex;
-    sub_validatedec = &sub_file_validatedec;
+void bintex_q_init(bintex_q* q, uint8_t* buffer, size_t alloc) {
+    q_init(q, buffer, alloc);
+}
+
+int bintex_q_init_grow(bintex_q* q, size_t alloc, bintex_alloc allocf, void* ud) {
+    uint8_t* buffer = NULL;
+    
+    if (allocf == NULL) {
+        allocf = &q_stdalloc;
+    }
+    if (alloc != 0) {
+        buffer = allocf(ud, NULL, 0, alloc);
+        if (buffer == NULL) {
+            q_init(q, NULL, 0);
+            return BINTEX_ERROR;
+        }
+    }
     
-    return sub_parsestream((void*)file, msg);
+    q_init(q, buffer, alloc);
+    q->overflow = &q_grow;
+    q->ext      = ud;
+    q->allocf   = allocf;
+    return 0;
 }
 
-int bintex_fs(FILE* file, unsigned char* stream_out, int size) {
-    bintex_q local;
-    q_init(&local, stream_out, size);
+void bintex_q_free(bintex_q* q) {
+    if ((q->allocf != NULL) && (q->front != NULL)) {
+        q->allocf(q->ext, q->front, q->alloc, 0);
+    }
+    q_init(q, NULL, 0);
+}
+
+void bintex_ctx_init(bintex_ctx* ctx) {
+    memset(ctx, 0, sizeof(bintex_ctx));
+    ctx->fd = -1;
+}
+
+void bintex_ctx_free(bintex_ctx* ctx) {
+    free(ctx->block);
+    bintex_ctx_init(ctx);
+}
+
+
+
+
+#ifdef __BINTEX_STATS__
+static __thread bintex_stats stats_thread;
+
+#   if !(defined(__x86_64__) || defined(__i386__))
+static uint64_t sub_statsns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+#   endif
+#endif
+
+int bintex_stats_get(bintex_stats* stats) {
+#   ifdef __BINTEX_STATS__
+    *stats = stats_thread;
+    return 0;
+#   else
+    memset(stats, 0, sizeof(bintex_stats));
+    return BINTEX_ERROR;
+#   endif
+}
+
+void bintex_stats_reset(void) {
+#   ifdef __BINTEX_STATS__
+    memset(&stats_thread, 0, sizeof(bintex_stats));
+#   endif
+}
+
+
+
+
+ssize_t bintex_iter_fq(FILE* file, bintex_q* msg) {
+    bintex_ctx ctx;
+    bintex_ctx_init(&ctx);
+    
+    // There is no context to hold read-ahead between calls, so the file is
+    // read a byte at a time with fgetc().  bintex_iter_fq_r() reads blocks.
+    sub_bindfile(&ctx, file);
+    return sub_parsestream(&ctx, msg);
+}
+
+ssize_t bintex_iter_fq_r(bintex_ctx* ctx, FILE* file, bintex_q* msg) {
+    if ((ctx->file != file) || (ctx->readc != &sub_blockgetc)) {
+        sub_bindstream(ctx, file);
+    }
+    ctx->error = sub_parsestream(ctx, msg);
+    return ctx->error;
+}
+
+ssize_t bintex_fs(FILE* file, unsigned char* stream_out, size_t size) {
+    bintex_ctx  ctx;
+    ssize_t     rc;
+    
+    bintex_ctx_init(&ctx);
+    rc = bintex_fs_r(&ctx, file, stream_out, size);
+    bintex_ctx_free(&ctx);
+    
+    return rc;
+}
+
+ssize_t bintex_fs_r(bintex_ctx* ctx, FILE* file, unsigned char* stream_out, size_t size) {
+    ssize_t rc;
+    
+    if ((ctx->file != file) || (ctx->readc != &sub_blockgetc)) {
+        sub_bindstream(ctx, file);
+    }
+    rc = sub_parseall(ctx, stream_out, size);
+    
+    // Read-ahead is given back to a seekable file, so the file position ends
+    // just past the input that was parsed.  Read-ahead from other streams 
+    // stays in ctx, for the next call with the same file.
+    if ((ctx->readc == &sub_blockgetc) && (ctx->fd < 0) && (ctx->end > ctx->cursor)) {
+        fseek(file, -(long)(ctx->end - ctx->cursor), SEEK_CUR);
+        ctx->end = ctx->cursor;
+    }
+    return rc;
+}
+
+
+
+
+
+
+ssize_t bintex_iter_sq(unsigned char **string, bintex_q* msg, size_t size) {
+    bintex_ctx ctx;
+    bintex_ctx_init(&ctx);
+    return bintex_iter_sq_r(&ctx, string, msg, size);
+}
+
+ssize_t bintex_iter_sq_r(bintex_ctx* ctx, unsigned char **string, bintex_q* msg, size_t size) {
+    uint8_t* back       = msg->back;
+    int (*overflow)(bintex_q*, size_t) = msg->overflow;
+    
+    // The output is limited to size bytes by moving the back of the queue.
+    // It can't grow while it is limited, since growth would reset the back.
+    if ((size != 0) && (size < q_space(msg))) {
+        msg->back       = msg->putcursor + size;
+        msg->overflow   = NULL;
+    }
+    
+    sub_bindbuffer(ctx, *string, NULL);
+    ctx->error      = sub_parsestream(ctx, msg);
+    *string         = (unsigned char*)ctx->cursor;
+    msg->back       = back;
+    msg->overflow   = overflow;
+    return ctx->error;
+}
+
+ssize_t bintex_ss(unsigned char *string, unsigned char* stream_out, size_t size) {
+    bintex_ctx ctx;
+    bintex_ctx_init(&ctx);
+    return bintex_ss_r(&ctx, string, stream_out, size);
+}
+
+ssize_t bintex_ss_r(bintex_ctx* ctx, unsigned char *string, unsigned char* stream_out, size_t size) {
+    // The whole string is parsed, so bound it once to enable the block
+    // decoders that work directly on the buffer.
+    sub_bindbuffer(ctx, string, string + strlen((char*)string));
+    return sub_parseall(ctx, stream_out, size);
+}
+
+ssize_t bintex_iter_snq(const uint8_t** in, size_t* in_len, bintex_q* msg) {
+    bintex_ctx ctx;
+    bintex_ctx_init(&ctx);
+    return bintex_iter_snq_r(&ctx, in, in_len, msg);
+}
+
+ssize_t bintex_iter_snq_r(bintex_ctx* ctx, const uint8_t** in, size_t* in_len, bintex_q* msg) {
+    sub_bindbuffer(ctx, *in, *in + *in_len);
+    ctx->error  = sub_parsestream(ctx, msg);
+    *in_len    -= (ctx->cursor - *in);
+    *in         = ctx->cursor;
+    return ctx->error;
+}
+
+ssize_t bintex_snq(const uint8_t* in, size_t in_len, bintex_q* msg) {
+    bintex_ctx ctx;
+    bintex_ctx_init(&ctx);
+    return bintex_snq_r(&ctx, in, in_len, msg);
+}
+
+ssize_t bintex_snq_r(bintex_ctx* ctx, const uint8_t* in, size_t in_len, bintex_q* msg) {
+    sub_bindbuffer(ctx, in, in + in_len);
+    return sub_parseq(ctx, msg);
+}
+
+ssize_t bintex_sn(const uint8_t* in, size_t in_len, uint8_t* out, size_t out_len) {
+    bintex_ctx ctx;
+    bintex_ctx_init(&ctx);
+    return bintex_sn_r(&ctx, in, in_len, out, out_len);
+}
+
+ssize_t bintex_sn_r(bintex_ctx* ctx, const uint8_t* in, size_t in_len, uint8_t* out, size_t out_len) {
+    sub_bindbuffer(ctx, in, in + in_len);
+    return sub_parseall(ctx, out, out_len);
+}
+
+ssize_t bintex_measure(const uint8_t* in, size_t in_len, size_t* sizes, size_t* count) {
+    bintex_ctx ctx;
+    bintex_ctx_init(&ctx);
+    return bintex_measure_r(&ctx, in, in_len, sizes, count);
+}
+
+ssize_t bintex_measure_r(bintex_ctx* ctx, const uint8_t* in, size_t in_len, size_t* sizes, size_t* count) {
+    bintex_q    sink;
+    uint8_t     scratch[256];
+    size_t      limit;
+    ssize_t     total   = 0;
+    size_t      exprs   = 0;
+    
+    // The counting sink is a small scratch queue that discards its data when
+    // full.  The largest single reservation made by the parser is 64 bytes.
+    q_init(&sink, scratch, sizeof(scratch));
+    sink.overflow   = &q_discard;
+    limit           = ((sizes != NULL) && (count != NULL)) ? *count : 0;
+    
+    sub_bindbuffer(ctx, in, in + in_len);
     
     while (1) {
-        int test;
+        ssize_t test;
         
-        test = bintex_iter_fq(file, &local);
+        test        = sub_parsestream(ctx, &sink);
+        ctx->error  = test;
         if (test < 0) break;
         
-#       ifdef __DEBUG__
-        {
-            int i;
-            uint8_t* s;
-            fprintf(stdout, "Data written to queue\n");
-            
-            for (s=(local.putcursor-test), i=0; s<local.putcursor; s++, i++) {
-                if ((i & 3) == 0) {
-                    fprintf(stdout, "%04X: ", (uint16_t)s);
-                }
-                fprintf(stdout, "%02X ", *s);
-                if ((i & 3) == 3) {
-                    fputc('\n', stdout);
-                }
-            } 
-    
-            if ((i & 3) != 0) {
-                fputc('\n', stdout);
-            }
-            
-            fputc('\n', stdout);
+        if (exprs < limit) {
+            sizes[exprs] = (size_t)test;
         }
-#       endif
+        exprs++;
+        total += test;
     }
     
-    return (local.putcursor - local.front);
+    if (count != NULL) {
+        *count = exprs;
+    }
+    return total;
 }
 
+ssize_t bintex_emit(const uint8_t* in, size_t in_len, char* out, size_t out_len, int flags) {
+    size_t need;
+    
+    // Sizing is cheap: the hex layout is computed, not scanned
+    need = sub_emit(NULL, in, in_len, flags);
+    if (out == NULL) {
+        return (ssize_t)need;
+    }
+    if (need > out_len) {
+        return BINTEX_FULL;
+    }
+    return (ssize_t)sub_emit(out, in, in_len, flags);
+}
 
+void bintex_push_init(bintex_ctx* ctx, bintex_q* msg) {
+    ctx->msg    = msg;
+    ctx->state  = PUSH_header;
+    ctx->toklen = 0;
+    ctx->pmark  = 0;
+}
 
+ssize_t bintex_feed(bintex_ctx* ctx, const uint8_t* chunk, size_t len) {
+    size_t  start;
+    int     rc = 0;
+    
+    start       = q_length(ctx->msg);
+    ctx->cursor = chunk;
+    ctx->end    = chunk + len;
+    
+    while ((ctx->cursor < ctx->end) && (rc == 0)) {
+        rc = sub_pushstep(ctx);
+    }
+    
+    if (rc == BINTEX_FULL) {
+        ctx->pmark = 0;
+    }
+    ctx->error = (rc < 0) ? rc : 0;
+    return (rc < 0) ? rc : (ssize_t)(q_length(ctx->msg) - start);
+}
 
+ssize_t bintex_finish(bintex_ctx* ctx) {
+    bintex_q*   msg = ctx->msg;
+    size_t      start;
+    int         status = 2;     // End of input terminates a token as an error
+    
+    start = q_length(msg);
+    
+    switch (ctx->state) {
+        case PUSH_header:
+        case PUSH_comment:  break;
+        case PUSH_binnum:   sub_putbin(&status, msg, ctx->tok, ctx->toklen);
+                            break;
+        case PUSH_hexnum:   sub_puthex(&status, msg, (const unsigned char*)ctx->tok, ctx->toklen);
+                            break;
+        case PUSH_decnum:   sub_putdec(&status, msg, ctx->tok, ctx->toklen);
+                            break;
+        default:            msg->putcursor  = msg->front + ctx->pmark;
+                            ctx->state      = PUSH_header;
+                            ctx->toklen     = 0;
+                            ctx->error      = BINTEX_ERROR;
+                            return BINTEX_ERROR;
+    }
+    
+    // The token is kept, so finishing can be retried after the queue is emptied
+    if (status == 3) {
+        ctx->error = BINTEX_FULL;
+        return BINTEX_FULL;
+    }
+    
+    ctx->state  = PUSH_header;
+    ctx->toklen = 0;
+    ctx->error  = 0;
+    return (ssize_t)(q_length(msg) - start);
+}
 
+int bintex_tpl_compile(bintex_tpl* tpl, const uint8_t* in, size_t in_len) {
+    bintex_ctx  ctx;
+    bintex_q    frame;
+    size_t      alloc = 0;
+    ssize_t     test;
+    
+    memset(tpl, 0, sizeof(bintex_tpl));
+    if (bintex_q_init_grow(&frame, 64, NULL, NULL) != 0) {
+        return BINTEX_ERROR;
+    }
+    
+    // Literal expressions are parsed into the frame as usual.  At each slot,
+    // the frame gets zeros for the size of a fixed slot, or nothing.
+    bintex_ctx_init(&ctx);
+    sub_bindbuffer(&ctx, in, in + in_len);
+    ctx.slots = 1;
+    
+    while (1) {
+        test = sub_parsestream(&ctx, &frame);
+        if (test != BINTEX_SLOT) {
+            if (test >= 0) continue;
+            if ((test == BINTEX_EOF) || (test == BINTEX_LINETERM)) break;
+            goto bintex_tpl_compile_error;
+        }
+        
+        if (tpl->slots == alloc) {
+            bintex_slot* grown;
+            alloc   = (alloc == 0) ? 8 : (2*alloc);
+            grown   = realloc(tpl->slot, alloc * sizeof(bintex_slot));
+            if (grown == NULL) {
+                goto bintex_tpl_compile_error;
+            }
+            tpl->slot = grown;
+        }
+        if (sub_tplslot(&ctx, &frame, &tpl->slot[tpl->slots]) != 0) {
+            goto bintex_tpl_compile_error;
+        }
+        tpl->slots++;
+    }
+    
+    tpl->frame      = frame.front;
+    tpl->frame_len  = q_length(&frame);
+    return 0;
+    
+    bintex_tpl_compile_error:
+    bintex_q_free(&frame);
+    bintex_tpl_free(tpl);
+    return BINTEX_ERROR;
+}
 
-int bintex_iter_sq(unsigned char **string, bintex_q* msg, int size) {
-    sub_getc        = &sub_buffergetc;
-    sub_validatehex = &sub_buffer_validatehex;
-    sub_validatedec = &sub_buffer_validatedec;
+int bintex_tpl_find(const bintex_tpl* tpl, const char* name) {
+    size_t i;
     
-    return sub_parsestream((void*)string, msg);
+    for (i=0; i<tpl->slots; i++) {
+        if (strncmp(tpl->slot[i].name, name, BINTEX_SLOTNAME) == 0) {
+            return (int)i;
+        }
+    }
+    return BINTEX_ERROR;
 }
 
-int bintex_ss(unsigned char *string, unsigned char* stream_out, int size) {
+ssize_t bintex_tpl_render(const bintex_tpl* tpl, const bintex_val* vals, uint8_t* out, size_t out_len) {
+    const uint8_t*  frame   = tpl->frame;
+    size_t          total   = tpl->frame_len;
+    size_t          pos     = 0;
+    size_t          i;
+    
+    for (i=0; i<tpl->slots; i++) {
+        if (tpl->slot[i].type == BINTEX_SLOT_VAR) {
+            total += vals[i].len;
+        }
+    }
+    if (total > out_len) {
+        return BINTEX_FULL;
+    }
+    
+    // The frame is copied in the runs between slots, so a variable slot
+    // moves the rest of the output along
+    for (i=0; i<tpl->slots; i++) {
+        const bintex_slot*  slot = &tpl->slot[i];
+        uint32_t            num  = vals[i].num;
+        
+        memcpy(out, frame + pos, slot->offset - pos);
+        out += slot->offset - pos;
+        pos  = slot->offset;
+        
+        switch (slot->type) {
+            case BINTEX_SLOT_NUM:
+                switch (slot->size) {
+                    case 4: *out++ = (uint8_t)(num >> 24);
+                            *out++ = (uint8_t)(num >> 16);
+                            /* fall through */
+                    case 2: *out++ = (uint8_t)(num >> 8);
+                            /* fall through */
+                    default:*out++ = (uint8_t)num;
+                            break;
+                }
+                pos += slot->size;
+                break;
+            
+            case BINTEX_SLOT_BYTES:
+                memcpy(out, vals[i].data, slot->size);
+                out += slot->size;
+                pos += slot->size;
+                break;
+            
+            default:
+                if (vals[i].len != 0) {
+                    memcpy(out, vals[i].data, vals[i].len);
+                    out += vals[i].len;
+                }
+                break;
+        }
+    }
+    memcpy(out, frame + pos, tpl->frame_len - pos);
+    
+    return (ssize_t)total;
+}
+
+void bintex_tpl_free(bintex_tpl* tpl) {
+    free(tpl->frame);
+    free(tpl->slot);
+    memset(tpl, 0, sizeof(bintex_tpl));
+}
+
+static ssize_t sub_parseall(bintex_ctx* ctx, unsigned char* stream_out, size_t size) {
     bintex_q local;
+    ssize_t  rc;
     
     q_init(&local, stream_out, size);
+    rc = sub_parseq(ctx, &local);
+    
+    // Output that stopped because it is full is not a complete result.  The
+    // expressions that fit are still in stream_out.
+    return (ctx->error == BINTEX_FULL) ? BINTEX_FULL : rc;
+}
+
+static ssize_t sub_parseq(bintex_ctx* ctx, bintex_q* msg) {
+    size_t mark;
+    
+    // An offset, not a pointer: a growable queue may move while it is written
+    mark = q_length(msg);
     
     while (1) {
-        int test;
+        ssize_t test;
         
-        test    = bintex_iter_sq(&string, &local, size);
-        size   -= test;
+        test        = sub_parsestream(ctx, msg);
+        ctx->error  = test;
         if (test < 0) break;
         
 #       ifdef __DEBUG__
         {
-            int i;
+            size_t i;
             uint8_t* s;
             fprintf(stdout, "Data written to queue\n");
             
-            for (s=(local.putcursor-test), i=0; s<local.putcursor; s++, i++) {
+            for (s=(msg->putcursor-test), i=0; s<msg->putcursor; s++, i++) {
                 if ((i & 3) == 0) {
-                    fprintf(stdout, "%04X: ", (uint16_t)s);
+                    fprintf(stdout, "%04zX: ", i);
                 }
                 fprintf(stdout, "%02X ", *s);
                 if ((i & 3) == 3) {
@@ -219,8 +789,66 @@ int bintex_ss(unsigned char *string, unsigned char* stream_out, int size) {
 #       endif
     }
     
-    return (local.putcursor - local.front);
+    return (ssize_t)(q_length(msg) - mark);
+}
+
+
+
+
+#if defined(__unix__) || defined(__APPLE__)
+ssize_t bintex_fd(int fd, unsigned char* stream_out, size_t size) {
+    bintex_ctx  ctx;
+    struct stat st;
+    off_t       pos;
+    uint8_t*    map;
+    ssize_t     rc;
+    
+    bintex_ctx_init(&ctx);
+    
+    // Descriptors that can't be mapped (pipes, sockets, ttys) are read in
+    // blocks.  Read-ahead is discarded, as with bintex_fs().
+    pos = lseek(fd, 0, SEEK_CUR);
+    if ((fstat(fd, &st) != 0) || !S_ISREG(st.st_mode) || (pos < 0)) {
+        sub_bindblock(&ctx, NULL, fd);
+        rc = sub_parseall(&ctx, stream_out, size);
+        bintex_ctx_free(&ctx);
+        return rc;
+    }
+    
+    if (pos >= st.st_size) {
+        return 0;
+    }
+    
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        return BINTEX_ERROR;
+    }
+    madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+    
+    // The mapping is not NUL-terminated, so it is parsed with a length bound.
+    // The file offset is left after the last character that was parsed.
+    sub_bindbuffer(&ctx, map+pos, map+st.st_size);
+    rc = sub_parseall(&ctx, stream_out, size);
+    lseek(fd, (off_t)(ctx.cursor - map), SEEK_SET);
+    munmap(map, (size_t)st.st_size);
+    
+    return rc;
+}
+
+ssize_t bintex_path(const char* path, unsigned char* stream_out, size_t size) {
+    int     fd;
+    ssize_t rc;
+    
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return BINTEX_ERROR;
+    }
+    rc = bintex_fd(fd, stream_out, size);
+    close(fd);
+    
+    return rc;
 }
+#endif
 
 
 
@@ -260,7 +888,7 @@ int parsefile_main(int argc, char** argv) {
         return 0;
     }
 
-    printf("%d Bytes written to output\n", bintex_fs(fp, msg_buffer, 512));
+    printf("%zd Bytes written to output\n", bintex_fs(fp, msg_buffer, 512));
     
     return 0;
 }
@@ -272,7 +900,7 @@ int parsestring_main(int argc, char** argv) {
     unsigned char   stream[512];
     unsigned char*  input;
     unsigned char*  output;
-    size_t bytes_out;
+    ssize_t bytes_out;
     
     //strcpy((char*)string, "[00 11 22 33] (32 64 96 128) d-5930 x9933 \"Blah\"");
     strcpy((char*)string, "[11223344 55667788 2233445566]");
@@ -281,7 +909,7 @@ int parsestring_main(int argc, char** argv) {
     
     bytes_out = bintex_ss(input, stream, 512);
     
-    printf("%zu Bytes written to output\n", bytes_out);
+    printf("%zd Bytes written to output\n", bytes_out);
     
     for (int i=0; i<bytes_out; i++) {
         printf("%02X ", stream[i]);
@@ -299,152 +927,213 @@ int parsestring_main(int argc, char** argv) {
 
 
 
-static int sub_buffergetc(void* stream) {
-    unsigned char c;
-    unsigned char **s;
-    s   = (unsigned char**)stream;
-    c   = **s;          //get character
-    *s  = *s + 1;       //increment buffer
-    
-    if (c != 0) {     //no EOFs
-        return c;
+static void sub_bindbuffer(bintex_ctx* ctx, const unsigned char* string, const unsigned char* end) {
+    ctx->readc          = (end == NULL) ? &sub_buffergetc : &sub_bufferngetc;
+    ctx->file           = NULL;
+    ctx->cursor         = string;
+    ctx->end            = end;
+}
+
+static void sub_bindfile(bintex_ctx* ctx, FILE* file) {
+    ctx->readc          = &sub_filegetc;
+    ctx->file           = file;
+    ctx->cursor         = NULL;
+    ctx->end            = NULL;
+}
+
+
+static void sub_bindblock(bintex_ctx* ctx, FILE* file, int fd) {
+    if (ctx->block == NULL) {
+        ctx->block = malloc(BINTEX_BLOCKSIZE);
+        if (ctx->block == NULL) {
+            // Without a block, a FILE can still be read unbuffered
+            sub_bindfile(ctx, file);
+            return;
+        }
+        ctx->blocksize = BINTEX_BLOCKSIZE;
     }
-    else {
-        return -1;
-    }    
+    ctx->readc          = &sub_blockgetc;
+    ctx->file           = file;
+    ctx->fd             = fd;
+    ctx->cursor         = ctx->block;
+    ctx->end            = ctx->block;
+    ctx->mark           = ctx->block;
+    ctx->eof            = 0;
 }
 
 
-static int sub_filegetc(void* stream) {
-    return fgetc((FILE*)stream);
+/// Binds a FILE to the block reader.  A stream that can't seek, such as a 
+/// pipe or tty, is read from its descriptor, since read() returns what has
+/// arrived while fread() waits for a whole block.
+static void sub_bindstream(bintex_ctx* ctx, FILE* file) {
+#   if defined(__unix__) || defined(__APPLE__)
+    if (fseek(file, 0, SEEK_CUR) != 0) {
+        sub_bindblock(ctx, file, fileno(file));
+        return;
+    }
+#   endif
+    sub_bindblock(ctx, file, -1);
 }
 
 
-static int sub_buffer_validatehex(void* stream) {
-    char* front;
-    int bytes_read;
+static int sub_blockfill(bintex_ctx* ctx) {
+    size_t  kept;
+    size_t  unread;
+    size_t  space;
+    unsigned char* fill;
+    long    rc;
     
-    front = *(char**)stream;
+    if (ctx->eof) {
+        return 0;
+    }
     
-    while (1) {
-        char a = *front++;
-        bytes_read++;
-        
-        if (a == 0) {
-            break;
-        }
-        if (a == ']') {
-            bytes_read = 0;
-            break;
-        }
-        if (!IS_HEXVAL(a) && !IS_WHITESPACE(a)) {
-            break;
+    // Move unread data, from the start of the current expression, to the 
+    // front of the block.  If the block is full of it (a long expression or
+    // lookahead) it is doubled.
+    kept    = ctx->cursor - ctx->mark;
+    unread  = ctx->end - ctx->mark;
+    if (unread == ctx->blocksize) {
+        unsigned char* block = realloc(ctx->block, ctx->blocksize*2);
+        if (block == NULL) {
+            return 0;
         }
+        ctx->block      = block;
+        ctx->blocksize *= 2;
+    }
+    else {
+        memmove(ctx->block, ctx->mark, unread);
+    }
+    fill        = ctx->block + unread;
+    space       = ctx->blocksize - unread;
+    ctx->mark   = ctx->block;
+    ctx->cursor = ctx->block + kept;
+    ctx->end    = fill;
+    
+    if (ctx->fd < 0) {
+        rc = (long)fread(fill, 1, space, ctx->file);
+    }
+    else {
+#       if defined(__unix__) || defined(__APPLE__)
+        do {
+            rc = (long)read(ctx->fd, fill, space);
+        } while ((rc < 0) && (errno == EINTR));
+#       else
+        rc = -1;
+#       endif
     }
     
-    return bytes_read;
+    if (rc <= 0) {
+        ctx->eof = 1;
+        return 0;
+    }
+    ctx->end += rc;
+    return (int)rc;
 }
 
-static int sub_file_validatehex(void* stream) {
-    fpos_t pos;
-    int bytes_read;
-    
-    fgetpos((FILE*)stream, &pos);
-    
-    while (1) {
-        int a = fgetc((FILE*)stream);
-        bytes_read++;
-        
-        if (a == EOF) {
-            break;
-        }
-        if (a == ']') {
-            bytes_read = 0;
-            break;
-        }
-        if (!IS_HEXVAL(a) && !IS_WHITESPACE(a)) {
-            break;
-        }
+
+static int sub_blockgetc(bintex_ctx* ctx) {
+    if ((ctx->cursor < ctx->end) || (sub_blockfill(ctx) > 0)) {
+        return *ctx->cursor++;
     }
-    
-    fsetpos((FILE*)stream, &pos);
-    
-    return bytes_read;
+    return -1;
 }
 
-static int sub_buffer_validatedec(void* stream) {
-    char* front;
-    int bytes_read;
-    
-    front = *(char**)stream;
+
+static int sub_buffergetc(bintex_ctx* ctx) {
+    unsigned char c;
+    c           = *ctx->cursor;     //get character
+    ctx->cursor = ctx->cursor + 1;  //increment buffer
     
-    while (1) {
-        char a = *front++;
-        bytes_read++;
-        
-        if (a == 0) {
-            break;
-        }
-        if (a == ')') {
-            bytes_read = 0;
-            break;
-        }
-        if (!IS_DECVAL(a) && !IS_WHITESPACE(a)) {
-            break;
-        }
+    if (c != 0) {     //no EOFs
+        return c;
     }
-    
-    return bytes_read;
+    else {
+        return -1;
+    }    
 }
 
-static int sub_file_validatedec(void* stream) {
-    fpos_t pos;
-    int bytes_read;
-    
-    fgetpos((FILE*)stream, &pos);
-    
-    while (1) {
-        int a = fgetc((FILE*)stream);
-        bytes_read++;
+
+static int sub_bufferngetc(bintex_ctx* ctx) {
+    if (ctx->cursor < ctx->end) {
+        unsigned char c;
+        c           = *ctx->cursor;
+        ctx->cursor = ctx->cursor + 1;
         
-        if (a == EOF) {
-            break;
-        }
-        if (a == ')') {
-            bytes_read = 0;
-            break;
-        }
-        if (!IS_DECVAL(a) && !IS_WHITESPACE(a)) {
-            break;
+        if (c != 0) {
+            return c;
         }
     }
-    
-    fsetpos((FILE*)stream, &pos);
-    
-    return bytes_read;
+    return -1;
 }
 
 
+static int sub_filegetc(bintex_ctx* ctx) {
+    return fgetc(ctx->file);
+}
+
 
+static ssize_t sub_parsestream(bintex_ctx* ctx, bintex_q* msg) {
+    Data_type   type;
+    ssize_t     rc;
 
+    PROBE1(expr_start, ctx);
+
+#   ifdef __BINTEX_STATS__
+    uint64_t    start = STATS_TICKS();
+    bintex_stat* stat;
+
+    rc      = sub_parseexpr(ctx, msg, &type);
+    stat    = &((ctx->stats != NULL) ? ctx->stats : &stats_thread)->type[type];
+    stat->exprs++;
+    stat->in_bytes  += (ctx->cursor - ctx->mark);
+    stat->out_bytes += (rc > 0) ? (uint64_t)rc : 0;
+    stat->cycles    += STATS_TICKS() - start;
+#   else
+    rc      = sub_parseexpr(ctx, msg, &type);
+#   endif
+
+    PROBE4(expr_end, ctx, (int)type, rc, (size_t)(ctx->cursor - ctx->mark));
+    return rc;
+}
 
-static int sub_parsestream(void* stream, bintex_q* msg) {
-    int status;
 
-    switch (sub_parse_header(stream)) {
-        case DATA_EOF:      return -1;
-        case DATA_error:    return -2;
-        case DATA_lineterm: return -3;
-        case DATA_comment:  return sub_passcomment(stream);
-        case DATA_ascii:    return sub_getascii(stream, msg);
-        case DATA_binnum:   return sub_getbinnum(&status, stream, msg);
-        case DATA_hexnum:   return sub_gethexnum(&status, stream, msg);
-        case DATA_hexblock: return sub_gethexblock(stream, msg);
-        case DATA_decnum:   return sub_getdecnum(&status, stream, msg);
-        case DATA_decblock: return sub_getdecblock(stream, msg);
+static inline ssize_t sub_parseexpr(bintex_ctx* ctx, bintex_q* msg, Data_type* type) {
+    int     status = 0;
+    ssize_t bytes_written;
+    
+    // The block reader keeps input from the mark onward, so the expression
+    // can be parsed again after the output has been flushed.
+    ctx->mark = ctx->cursor;
+
+    switch (*type = sub_parse_header(ctx)) {
+        case DATA_EOF:      return BINTEX_EOF;
+        case DATA_error:    return BINTEX_ERROR;
+        case DATA_lineterm: return BINTEX_LINETERM;
+        case DATA_comment:  return sub_passcomment(ctx);
+        case DATA_ascii:    bytes_written = sub_getascii(ctx, msg);
+                            break;
+        case DATA_binnum:   bytes_written = sub_getbinnum(&status, ctx, msg);
+                            break;
+        case DATA_hexnum:   bytes_written = sub_gethexnum(&status, ctx, msg);
+                            break;
+        case DATA_hexblock: bytes_written = sub_gethexblock(ctx, msg);
+                            break;
+        case DATA_decnum:   bytes_written = sub_getdecnum(&status, ctx, msg);
+                            break;
+        case DATA_decblock: bytes_written = sub_getdecblock(ctx, msg);
+                            break;
+        case DATA_slot:     return ctx->slots ? BINTEX_SLOT : BINTEX_ERROR;
+        default:            return BINTEX_ERROR;
     }
     
-    return -2;
+    // Status 3 is set by a token that could not reserve its output
+    if (status == 3) {
+        bytes_written = BINTEX_FULL;
+    }
+    if ((bytes_written == BINTEX_FULL) && (ctx->readc != &sub_filegetc)) {
+        ctx->cursor = ctx->mark;
+    }
+    return bytes_written;
 }
 
 
@@ -453,37 +1142,35 @@ static int sub_parsestream(void* stream, bintex_q* msg) {
 
 
 
-static Data_type sub_parse_header(void* stream) {
-    char next;
+/// Skips whitespace and leading 0's (in case a person uses "0x"), and returns
+/// the type of the expression started by the next character.  The character
+/// is read as an int, so a 0xFF byte is an error, not EOF.
+static Data_type sub_parse_header(bintex_ctx* ctx) {
+    int next;
+    int type;
+    int skipped = 0;
 
-    parse_header_getchar:
-    next = sub_getc(stream);
-    switch (next) {
-        case '\n':  //Bypass Newlines
-        case '\r':  //Bypass returns
-        case '\t':  //Bypass tabs
-        case '0':   //Bypass leading 0's (in case person uses "0x")
-        case ' ':   //Bypass space
-                    goto parse_header_getchar;
-        
-        case '#':   return DATA_comment;
-        case '"':   return DATA_ascii;
-        case 'b':   return DATA_binnum;
-        case 'x':   return DATA_hexnum;
-        case '[':   return DATA_hexblock;
-        case 'd':   return DATA_decnum;
-        case '(':   return DATA_decblock;
-        
-        case ';':   return DATA_lineterm;
-        case -1:    return DATA_EOF;
-        
-        default:    return DATA_error;
+    do {
+        // Long runs of whitespace in buffered input are skipped by the index
+        if ((++skipped == 8) && (ctx->end != NULL)) {
+            sub_skipws(ctx);
+        }
+        next = sub_getc(ctx);
+        if (next < 0) {
+            return DATA_EOF;
+        }
+        type = CH_HEADER(next);
+    } while (type == CH_SKIP);
+
+    if (type == DATA_error) {
+        PROBE2(header_error, ctx, next);
     }
+    return (Data_type)type;
 }
 
 
 
-static int sub_passcomment(void* stream) {
+static int sub_passcomment(bintex_ctx* ctx) {
     char subcomment[8];
     int next;
     int i = 0;
@@ -492,7 +1179,7 @@ static int sub_passcomment(void* stream) {
     
     //buffer subcomment
     while (i<8) {
-        next            = sub_getc(stream);
+        next            = sub_getc(ctx);
         subcomment[i++] = next;
         
         switch (next) {
@@ -511,7 +1198,7 @@ static int sub_passcomment(void* stream) {
     
     //bypass whitespace after subcomment
     sub_passcomment_passws:
-    next = sub_getc(stream);
+    next = sub_getc(ctx);
     switch (next) {
         case -1:    return -1;
         case '\n':  return 0;
@@ -529,7 +1216,11 @@ static int sub_passcomment(void* stream) {
         if (next == '\n') 
             return 0;
         
-        next = sub_getc(stream);
+        // Buffered input is skipped to the next '\n' or NUL by the index
+        if (ctx->end != NULL) {
+            sub_skipline(ctx);
+        }
+        next = sub_getc(ctx);
     } 
     
     return -1;
@@ -539,90 +1230,370 @@ static int sub_passcomment(void* stream) {
 
 
 
-static int sub_getascii(void* stream, bintex_q* msg) {
-    char    next;
-    int     bytes_written;
+/// Reads the rest of a template slot, after the '%': an optional {name}, then
+/// c, s or l (optionally after u) for a number, x and a byte count for fixed
+/// bytes, or a for variable bytes.  Template input is always a buffer.
+static int sub_tplslot(bintex_ctx* ctx, bintex_q* frame, bintex_slot* slot) {
+    const unsigned char* p      = ctx->cursor;
+    const unsigned char* end    = ctx->end;
+    size_t  n;
     
-    bytes_written = q_length(msg);
+    memset(slot, 0, sizeof(bintex_slot));
+    
+    if ((p < end) && (*p == '{')) {
+        for (n=0, p++; (p < end) && (*p != '}'); n++, p++) {
+            if ((n >= (BINTEX_SLOTNAME-1)) || (*p == 0)) {
+                return -1;
+            }
+            slot->name[n] = (char)*p;
+        }
+        if (p++ == end) {
+            return -1;
+        }
+    }
+    if ((p < end) && (*p == 'u')) {
+        p++;
+    }
+    if (p == end) {
+        return -1;
+    }
+    
+    slot->type = BINTEX_SLOT_NUM;
+    switch (*p++) {
+        case 'c':   slot->size = 1;  break;
+        case 's':   slot->size = 2;  break;
+        case 'l':   slot->size = 4;  break;
+        case 'a':   slot->type = BINTEX_SLOT_VAR;
+                    break;
+        case 'x':   slot->type = BINTEX_SLOT_BYTES;
+                    for (n=0; (p < end) && IS_DECVAL(*p) && (n <= 65535); p++) {
+                        n = (n * 10) + (*p - '0');
+                    }
+                    if ((n == 0) || (n > 65535)) {
+                        return -1;
+                    }
+                    slot->size = (uint16_t)n;
+                    break;
+        default:    return -1;
+    }
+    
+    ctx->cursor     = p;
+    slot->offset    = (uint32_t)q_length(frame);
+    if (slot->type != BINTEX_SLOT_VAR) {
+        if (q_reserve(frame, slot->size) != 0) {
+            return -1;
+        }
+        memset(frame->putcursor, 0, slot->size);
+        frame->putcursor += slot->size;
+    }
+    return 0;
+}
+
+
+
+
+static ssize_t sub_getascii(bintex_ctx* ctx, bintex_q* msg) {
+    int     next;
+    ssize_t bytes_written = 0;
+    size_t  mark;
+    
+    mark = q_length(msg);
     
     while (1) {
-        next = sub_getc(stream);
+        // Runs of plain characters in buffered input are copied in one piece
+        if (ctx->end != NULL) {
+            const unsigned char* run;
+            size_t span;
+            
+            span    = sub_strrun(ctx->cursor, ctx->end - ctx->cursor);
+            run     = ctx->cursor + span;
+            if (span != 0) {
+                if (q_reserve(msg, span) != 0) {
+                    msg->putcursor = msg->front + mark;
+                    return BINTEX_FULL;
+                }
+                q_writestring(msg, (uint8_t*)ctx->cursor, span);
+                ctx->cursor     = run;
+                bytes_written  += span;
+                continue;
+            }
+        }
+        
+        next = sub_getc(ctx);
         
         if (next == '"') {
             break;   
         }
         
+        // An unterminated string is removed, like an unterminated block
+        if (next < 0) {
+            msg->putcursor = msg->front + mark;
+            return BINTEX_ERROR;
+        }
+        
         if (next == '\\') {
-            switch (sub_getc(stream)) {
-                case 'a':   next = '\a';    break;
-                case '\\':  next = '\\';    break;
-                case 'b':   next = '\b';    break;
-                case 'r':   next = '\r';    break;
-                case '"':   next = '\"';    break;
-                case 'f':   next = '\f';    break;
-                case 't':   next = '\t';    break;
-                case 'n':   next = '\n';    break;
-                case '0':   next = '\0';    break;
-                case '\'':  next = '\'';    break;
-                case 'v':   next = '\v';    break;
-                case '?':   next = '\?';    break;
-            } 
+            next = sub_escape(sub_getc(ctx));
         }
         
+        if (q_reserve(msg, 1) != 0) {
+            msg->putcursor = msg->front + mark;
+            return BINTEX_FULL;
+        }
         q_writebyte(msg, next);
+        bytes_written++;
     }
     
-    bytes_written = (q_length(msg) - bytes_written);
     return bytes_written;
 }
 
 
 
 
-static int sub_gethexblock(void* stream, bintex_q* msg) {
-    int status;
-    int bytes_written;
-    bytes_written = q_length(msg);
+/// Character produced by an escape sequence.  An unknown escape produces the
+/// backslash, and the character after it is dropped.
+static int sub_escape(int next) {
+    switch (next) {
+        case 'a':   return '\a';
+        case '\\':  return '\\';
+        case 'b':   return '\b';
+        case 'r':   return '\r';
+        case '"':   return '\"';
+        case 'f':   return '\f';
+        case 't':   return '\t';
+        case 'n':   return '\n';
+        case '0':   return '\0';
+        case '\'':  return '\'';
+        case 'v':   return '\v';
+        case '?':   return '\?';
+    } 
+    return '\\';
+}
+
 
-    // Validate the hex block
-    status = sub_validatehex(stream);
 
+
+static ssize_t sub_gethexblock(bintex_ctx* ctx, bintex_q* msg) {
+    int     status = 0;
+    ssize_t bytes_written = 0;
+    size_t  mark;
+    mark = q_length(msg);
+
+    // The block is validated as it is decoded.  If a character that is not
+    // hex, whitespace or ']' is found, the output of the block is removed.
     while (status == 0) {
-        sub_gethexnum(&status, stream, msg);
+        bytes_written += sub_gethexnum(&status, ctx, msg);
+    }
+    
+    if (status != 1) {
+        msg->putcursor = msg->front + mark;
+        return (status == 3) ? BINTEX_FULL : BINTEX_ERROR;
+    }
+
+    return bytes_written;
+}
+
+
+
+
+static ssize_t sub_getdecblock(bintex_ctx* ctx, bintex_q* msg) {
+    int     status = 0;
+    ssize_t bytes_written = 0;
+    size_t  mark;
+    mark = q_length(msg);
+
+    // Validated as it is decoded, the same way as a hex block
+    while (status == 0) {
+        bytes_written += sub_getdecnum(&status, ctx, msg);
+    }
+    
+    if (status != 1) {
+        msg->putcursor = msg->front + mark;
+        return (status == 3) ? BINTEX_FULL : BINTEX_ERROR;
+    }
+
+    return bytes_written;
+}
+
+
+
+
+
+/** Push parser step.  Parses the character at ctx->cursor, or a run of them,
+  * in the current state and advances the cursor past what it used.  Tokens
+  * are collected in ctx->tok with the same limits as the pull parser, and are
+  * written with the same functions, so the output is identical.  A token that
+  * reaches its limit is written when the next character arrives, and that
+  * character is then parsed again.  If the output is full, BINTEX_FULL is
+  * returned with the cursor and state unchanged.
+  */
+static int sub_pushstep(bintex_ctx* ctx) {
+    bintex_q*   msg = ctx->msg;
+    int         c   = *ctx->cursor;
+    int         status;
+    
+    switch (ctx->state) {
+        case PUSH_header:
+            ctx->toklen = 0;
+            switch (CH_HEADER(c)) {
+                case CH_SKIP:       break;
+                case DATA_comment:  ctx->state = PUSH_comment;     break;
+                case DATA_binnum:   ctx->state = PUSH_binnum;      break;
+                case DATA_hexnum:   ctx->state = PUSH_hexnum;      break;
+                case DATA_decnum:   ctx->state = PUSH_decnum;      break;
+                case DATA_ascii:    ctx->state = PUSH_ascii;       
+                                    ctx->pmark = q_length(msg);    break;
+                case DATA_hexblock: ctx->state = PUSH_hexblock;    
+                                    ctx->pmark = q_length(msg);    break;
+                case DATA_decblock: ctx->state = PUSH_decblock;    
+                                    ctx->pmark = q_length(msg);    break;
+                case DATA_lineterm: ctx->cursor++;
+                                    return BINTEX_LINETERM;
+                default:            ctx->cursor++;
+                                    return BINTEX_ERROR;
+            }
+            break;
+        
+        case PUSH_comment:
+            if (c == '\n') {
+                ctx->state = PUSH_header;
+            }
+            break;
+        
+        case PUSH_ascii:
+            if (c == '"') {
+                ctx->state = PUSH_header;
+            }
+            else if (c == '\\') {
+                ctx->state = PUSH_escape;
+            }
+            else {
+                const unsigned char* run = ctx->cursor;
+                size_t span;
+                
+                while ((run < ctx->end) && (*run != '"') && (*run != '\\')) {
+                    run++;
+                }
+                // Output is not rolled back after a flush, so a run that 
+                // doesn't fit can be written in pieces
+                span = run - ctx->cursor;
+                if (q_reserve(msg, span) != 0) {
+                    span = q_space(msg);
+                    if (span == 0) {
+                        return BINTEX_FULL;
+                    }
+                    run = ctx->cursor + span;
+                }
+                q_writestring(msg, (uint8_t*)ctx->cursor, span);
+                ctx->cursor = run;
+                return 0;
+            }
+            break;
+        
+        case PUSH_escape:
+            if (q_reserve(msg, 1) != 0) {
+                return BINTEX_FULL;
+            }
+            q_writebyte(msg, sub_escape(c));
+            ctx->state = PUSH_ascii;
+            break;
+        
+        case PUSH_binnum:
+            if ((ctx->toklen < 32) && IS_BINVAL(c)) {
+                ctx->tok[ctx->toklen++] = c;
+                break;
+            }
+            status = 0;
+            sub_putbin(&status, msg, ctx->tok, ctx->toklen);
+            if (status == 3) {
+                return BINTEX_FULL;
+            }
+            ctx->state = PUSH_header;
+            if (ctx->toklen < 32) {
+                break;
+            }
+            return 0;
+        
+        case PUSH_hexnum:
+        case PUSH_hexblock:
+            if (ctx->toklen < 64) {
+                if (IS_HEXVAL(c)) {
+                    do {
+                        ctx->tok[ctx->toklen++] = *ctx->cursor++;
+                    } while ((ctx->toklen < 64) && (ctx->cursor < ctx->end) && IS_HEXVAL(*ctx->cursor));
+                    return 0;
+                }
+                status = (c == ']') ? 1 : IS_WHITESPACE(c) ? 0 : 2;
+            }
+            else {
+                status = 0;
+            }
+            sub_puthex(&status, msg, (const unsigned char*)ctx->tok, ctx->toklen);
+            goto sub_pushstep_endtoken;
+        
+        case PUSH_decnum:
+        case PUSH_decblock:
+            if (ctx->toklen < 15) {
+                if (IS_DECTOKEN(c)) {
+                    ctx->tok[ctx->toklen++] = c;
+                    break;
+                }
+                status = (c == ')') ? 1 : IS_WHITESPACE(c) ? 0 : 2;
+            }
+            else {
+                status = 0;
+            }
+            sub_putdec(&status, msg, ctx->tok, ctx->toklen);
+            goto sub_pushstep_endtoken;
+    }
+    
+    ctx->cursor++;
+    return 0;
+    
+    // A full token leaves the character that follows it to be parsed again.
+    // Errors in a single token are ignored, as in the pull parser, but an 
+    // error in a block removes the output of the block.
+    sub_pushstep_endtoken:
+    if (status == 3) {
+        return BINTEX_FULL;
+    }
+    if (ctx->toklen < ((ctx->state <= PUSH_hexblock) ? 64 : 15)) {
+        ctx->cursor++;
+    }
+    ctx->toklen = 0;
+    
+    if ((ctx->state == PUSH_hexnum) || (ctx->state == PUSH_decnum) || (status == 1)) {
+        ctx->state = PUSH_header;
+    }
+    else if (status == 2) {
+        msg->putcursor  = msg->front + ctx->pmark;
+        ctx->state      = PUSH_header;
+        return BINTEX_ERROR;
     }
-
-    bytes_written = q_length(msg) - bytes_written;
-    return bytes_written;
+    return 0;
 }
 
 
 
-
-static int sub_getdecblock(void* stream, bintex_q* msg) {
-    int status = 0;
-    int bytes_written = q_length(msg);
-
-
-
-    while (status == 0) {
-        sub_getdecnum(&status, stream, msg);
-    }
-
-    bytes_written = q_length(msg) - bytes_written;
-    return bytes_written;
+static int sub_getbinnum(int* status, bintex_ctx* ctx, bintex_q* msg) {
+    int     digits;
+    char    buf[33];
+    
+    digits = sub_bindigits(status, ctx, buf, 32);
+    return sub_putbin(status, msg, buf, digits);
 }
 
 
-
-static int sub_getbinnum(int* status, void* stream, bintex_q* msg) {
-    int     digits;
+/// Writes a token of binary digits collected by sub_bindigits()
+static int sub_putbin(int* status, bintex_q* msg, const char* buf, int digits) {
     int     i = 0;
     int     shift;
     char    next;
     char    byte = 0;
-    char    buf[33];
     
-    digits = sub_bindigits(status, stream, buf, 32);
+    if (q_reserve(msg, (digits+7)/8) != 0) {
+        *status = 3;
+        return 0;
+    }
     
     // If the length of digits is not byte-aligned, pad first byte
     shift = (digits & 7);
@@ -647,72 +1618,377 @@ static int sub_getbinnum(int* status, void* stream, bintex_q* msg) {
 
 
 
-static int sub_gethexnum(int* status, void* stream, bintex_q* msg) {
+static int sub_gethexnum(int* status, bintex_ctx* ctx, bintex_q* msg) {
     int     digits;
-    int     i = 0;
     char    buf[72];
 
-    digits = sub_hexdigits(status, stream, buf, 64);
+    // Bounded in-memory input is decoded directly from the buffer
+    if (ctx->end != NULL) {
+        return sub_gethexnum_buf(status, ctx, msg);
+    }
+    
+    digits = sub_hexdigits(status, ctx, buf, 64);
+    return sub_puthex(status, msg, (const unsigned char*)buf, digits);
+}
+
+
+
+/** Block hex decoder for bounded in-memory input.
+  * Produces the same output as sub_hexdigits() + sub_gethexnum(): runs of up
+  * to 64 digits are decoded with the odd-nibble rule, and the character that
+  * ends the run is consumed and classified into *status.  The vector paths
+  * classify and pack 16 (SSE2) or 32 (AVX2) characters per step.
+  */
+#ifdef BINTEX_SSE2
+static inline int sub_hexclass_sse2(__m128i v, __m128i* nibbles) {
+    __m128i d   = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+    __m128i a   = _mm_sub_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    __m128i dm  = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d);
+    __m128i am  = _mm_cmpeq_epi8(_mm_min_epu8(a, _mm_set1_epi8(5)), a);
+    
+    *nibbles    = _mm_or_si128( _mm_and_si128(dm, d), 
+                                _mm_and_si128(am, _mm_add_epi8(a, _mm_set1_epi8(10))) );
+    return _mm_movemask_epi8(_mm_or_si128(dm, am));
+}
+
+static inline void sub_hexpack16_sse2(uint8_t* out, const unsigned char* in) {
+    __m128i nib;
+    __m128i pair;
+    sub_hexclass_sse2(_mm_loadu_si128((const __m128i*)in), &nib);
+    
+    // 16 bit lanes hold (low nibble << 8) | high nibble
+    pair = _mm_or_si128( _mm_slli_epi16(_mm_and_si128(nib, _mm_set1_epi16(0x00FF)), 4),
+                         _mm_srli_epi16(nib, 8) );
+    _mm_storel_epi64((__m128i*)out, _mm_packus_epi16(pair, pair));
+}
+#endif
+
+#ifdef BINTEX_AVX2
+static BINTEX_AVX2_TARGET int sub_hexclass_avx2(__m256i v, __m256i* nibbles) {
+    __m256i d   = _mm256_sub_epi8(v, _mm256_set1_epi8('0'));
+    __m256i a   = _mm256_sub_epi8(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+    __m256i dm  = _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8(9)), d);
+    __m256i am  = _mm256_cmpeq_epi8(_mm256_min_epu8(a, _mm256_set1_epi8(5)), a);
+    
+    *nibbles    = _mm256_or_si256( _mm256_and_si256(dm, d), 
+                                   _mm256_and_si256(am, _mm256_add_epi8(a, _mm256_set1_epi8(10))) );
+    return _mm256_movemask_epi8(_mm256_or_si256(dm, am));
+}
+
+static BINTEX_AVX2_TARGET int sub_hexrun_avx2(const unsigned char* in, int avail) {
+    __m256i nib;
+    int     mask;
+    int     run = 0;
     
-    // If the length of digits is odd, write the first hex nibble as a byte
-    if (digits & 1) {      
-        q_writebyte(msg, sub_char2hex(buf[i++]));
+    while (((avail - run) >= 32) && (run < 64)) {
+        mask = sub_hexclass_avx2(_mm256_loadu_si256((const __m256i*)(in+run)), &nib);
+        if (mask != -1) {
+            return run + __builtin_ctz(~mask);
+        }
+        run += 32;
     }
+    return run;
+}
+
+static BINTEX_AVX2_TARGET int sub_hexpack_avx2(uint8_t* out, const unsigned char* in, int digits) {
+    int i;
     
-    while (i < digits) {       
-        char byte_data;
-        byte_data = (sub_char2hex(buf[i++]) << 4) & 0xF0;
-        byte_data |= sub_char2hex(buf[i++]) & 0x0F;
-        q_writebyte(msg, byte_data);        
+    for (i=0; (digits-i) >= 32; i+=32, out+=16) {
+        __m256i nib;
+        __m256i pair;
+        sub_hexclass_avx2(_mm256_loadu_si256((const __m256i*)(in+i)), &nib);
+        pair = _mm256_or_si256( _mm256_slli_epi16(_mm256_and_si256(nib, _mm256_set1_epi16(0x00FF)), 4),
+                                _mm256_srli_epi16(nib, 8) );
+        pair = _mm256_permute4x64_epi64(_mm256_packus_epi16(pair, pair), 0x08);
+        _mm_storeu_si128((__m128i*)out, _mm256_castsi256_si128(pair));
+    }
+    return i;
+}
+#endif
+
+
+/** Structural index of 64 bytes of buffered input.  Each bitmap has bit i set
+  * for byte i that is:
+  * ws              skipped before an expression: whitespace and '0'
+  * line            the end of a comment: '\n' or NUL
+  * str             the end of a run of plain string characters: '"', '\\'
+  *                 or NUL
+  *
+  * The parser indexes a window when it has a run to skip, and walks the 
+  * bitmaps with ctz instead of testing each byte.  Input shorter than a
+  * window, and input without SSE2, is scanned a byte at a time.
+  */
+#ifdef BINTEX_SSE2
+static inline void sub_index16_sse2(ch_index* ix, __m128i v, int shift) {
+    __m128i nl  = _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'));
+    __m128i nul = _mm_cmpeq_epi8(v, _mm_setzero_si128());
+    __m128i ws  = _mm_or_si128( _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), nl),
+                                _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')),
+                                _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\t')),
+                                             _mm_cmpeq_epi8(v, _mm_set1_epi8('0')))) );
+    __m128i str = _mm_or_si128( _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')), nul),
+                                _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')) );
+    
+    ix->ws     |= (uint64_t)(uint16_t)_mm_movemask_epi8(ws) << shift;
+    ix->line   |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_or_si128(nl, nul)) << shift;
+    ix->str    |= (uint64_t)(uint16_t)_mm_movemask_epi8(str) << shift;
+}
+#endif
+
+#ifdef BINTEX_AVX2
+static BINTEX_AVX2_TARGET void sub_index64_avx2(ch_index* ix, const unsigned char* in) {
+    int half;
+    
+    for (half=0; half<2; half++) {
+        __m256i v   = _mm256_loadu_si256((const __m256i*)(in + (32*half)));
+        __m256i nl  = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'));
+        __m256i nul = _mm256_cmpeq_epi8(v, _mm256_setzero_si256());
+        __m256i ws  = _mm256_or_si256( _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), nl),
+                                       _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')),
+                                       _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')),
+                                                       _mm256_cmpeq_epi8(v, _mm256_set1_epi8('0')))) );
+        __m256i str = _mm256_or_si256( _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')), nul),
+                                       _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')) );
+        
+        ix->ws     |= (uint64_t)(uint32_t)_mm256_movemask_epi8(ws) << (32*half);
+        ix->line   |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_or_si256(nl, nul)) << (32*half);
+        ix->str    |= (uint64_t)(uint32_t)_mm256_movemask_epi8(str) << (32*half);
+    }
+}
+#endif
+
+#ifdef BINTEX_SSE2
+static inline void sub_index64(ch_index* ix, const unsigned char* in) {
+    int i;
+    
+    ix->ws      = 0;
+    ix->line    = 0;
+    ix->str     = 0;
+#   ifdef BINTEX_AVX2
+    if (HAS_AVX2()) {
+        sub_index64_avx2(ix, in);
+        return;
+    }
+#   endif
+    for (i=0; i<64; i+=16) {
+        sub_index16_sse2(ix, _mm_loadu_si128((const __m128i*)(in+i)), i);
+    }
+}
+#endif
+
+
+/// Moves the cursor past whitespace and '0's, up to the end of the buffer
+static void sub_skipws(bintex_ctx* ctx) {
+    const unsigned char* p = ctx->cursor;
+    
+#   ifdef BINTEX_SSE2
+    while ((ctx->end - p) >= 64) {
+        ch_index ix;
+        sub_index64(&ix, p);
+        if (~ix.ws != 0) {
+            ctx->cursor = p + __builtin_ctzll(~ix.ws);
+            return;
+        }
+        p += 64;
+    }
+#   endif
+    while ((p < ctx->end) && (CH_HEADER(*p) == CH_SKIP)) {
+        p++;
     }
+    ctx->cursor = p;
+}
+
+
+/// Moves the cursor to the next '\n' or NUL, or to the end of the buffer
+static void sub_skipline(bintex_ctx* ctx) {
+    const unsigned char* p = ctx->cursor;
     
-    return (i+1)/2;
+#   ifdef BINTEX_SSE2
+    while ((ctx->end - p) >= 64) {
+        ch_index ix;
+        sub_index64(&ix, p);
+        if (ix.line != 0) {
+            ctx->cursor = p + __builtin_ctzll(ix.line);
+            return;
+        }
+        p += 64;
+    }
+#   endif
+    while ((p < ctx->end) && (*p != '\n') && (*p != 0)) {
+        p++;
+    }
+    ctx->cursor = p;
 }
 
 
+/// Length of the run of plain string characters at in, up to 64
+static size_t sub_strrun(const unsigned char* in, size_t avail) {
+    size_t run = 0;
+    
+#   ifdef BINTEX_SSE2
+    if (avail >= 64) {
+        ch_index ix;
+        sub_index64(&ix, in);
+        return (ix.str != 0) ? (size_t)__builtin_ctzll(ix.str) : 64;
+    }
+#   endif
+    avail = (avail > 64) ? 64 : avail;
+    while ((run < avail) && (in[run] != '"') && (in[run] != '\\') && (in[run] != 0)) {
+        run++;
+    }
+    return run;
+}
 
 
-static char sub_char2hex(char input) {
-    char output = input;
 
-    if ((input >= '0') && (input <= '9')) {
-        output -= '0';
+static int sub_gethexnum_buf(int* status, bintex_ctx* ctx, bintex_q* msg) {
+    const unsigned char* in;
+    int     avail;
+    int     digits  = 0;
+    int     next;
+    
+    // A block reader must hold the whole run and its terminator.  It is only
+    // filled while the run reaches the end of the block, so a stream is not
+    // waited on for more input than the token needs.
+    if (ctx->readc == &sub_blockgetc) {
+        size_t run = 0;
+        do {
+            while (((ctx->cursor + run) < ctx->end) && IS_HEXVAL(ctx->cursor[run])) {
+                run++;
+            }
+        } while (((ctx->cursor + run) == ctx->end) && (run <= 64) && (sub_blockfill(ctx) > 0));
     }
-    else if ((input >= 'a') && (input <= 'f')) {
-        output -= ('a' - 10);
+    
+    in      = ctx->cursor;
+    avail   = (ctx->end - ctx->cursor) > 64 ? 64 : (int)(ctx->end - ctx->cursor);
+    *status = 0;
+    
+    // Measure the run of hex digits
+#   ifdef BINTEX_AVX2
+    if (HAS_AVX2()) {
+        digits = sub_hexrun_avx2(in, avail);
     }
-    else if ((input >= 'A') && (input <= 'F')) {
-        output -= ('A' - 10);
+#   endif
+#   ifdef BINTEX_SSE2
+    while ((avail - digits) >= 16) {
+        __m128i nib;
+        int     mask;
+        mask = sub_hexclass_sse2(_mm_loadu_si128((const __m128i*)(in+digits)), &nib);
+        if (mask != 0xFFFF) {
+            digits += __builtin_ctz(~mask);
+            goto sub_gethexnum_buf_decode;
+        }
+        digits += 16;
     }
-    else {
-        output = 0;
+#   endif
+    while ((digits < avail) && IS_HEXVAL(in[digits])) {
+        digits++;
     }
     
-    return output;
+#   ifdef BINTEX_SSE2
+    sub_gethexnum_buf_decode:
+#   endif
+    sub_puthex(status, msg, in, digits);
+    if (*status == 3) {
+        return 0;
+    }
+    ctx->cursor += digits;
+    
+    // Consume and classify the character that ended the run, as in 
+    // sub_hexdigits().  A full 64 digit run leaves it for the next call.
+    if (digits < 64) {
+        next = sub_getc(ctx);
+        if (next == ']') {
+            *status = 1;
+        }
+        else if (!IS_WHITESPACE(next)) {
+            *status = 2;
+        }
+    }
+    
+    return (digits+1)/2;
+}
+
+
+
+/// Writes a run of hex digits: the first nibble of an odd run as a byte, then
+/// packed pairs.  The vector paths pack 16 (SSE2) or 32 (AVX2) digits per step.
+static int sub_puthex(int* status, bintex_q* msg, const unsigned char* in, int digits) {
+    int i = 0;
+    
+    if (q_reserve(msg, (digits+1)/2) != 0) {
+        *status = 3;
+        return 0;
+    }
+    if (digits & 1) {
+        q_writebyte(msg, sub_char2hex(in[i++]));
+    }
+#   ifdef BINTEX_AVX2
+    if (HAS_AVX2()) {
+        int packed = sub_hexpack_avx2(msg->putcursor, &in[i], digits-i);
+        msg->putcursor += packed/2;
+        i += packed;
+    }
+#   endif
+#   ifdef BINTEX_SSE2
+    for (; (digits-i) >= 16; i+=16) {
+        sub_hexpack16_sse2(msg->putcursor, &in[i]);
+        msg->putcursor += 8;
+    }
+#   endif
+    while (i < digits) {
+        char byte_data;
+        byte_data = (sub_char2hex(in[i++]) << 4) & 0xF0;
+        byte_data |= sub_char2hex(in[i++]) & 0x0F;
+        q_writebyte(msg, byte_data);
+    }
+    
+    return (digits+1)/2;
+}
+
+
+
+
+static char sub_char2hex(char input) {
+    return (char)CH_NIBBLE(input);
 }
 
 
 
 
 
-static int sub_getdecnum(int* status, void* stream, bintex_q* msg) {
+static int sub_getdecnum(int* status, bintex_ctx* ctx, bintex_q* msg) {
     int     digits;
-  //char    next;
     char    buf[16];
+    
+    // Buffer until whitespace or ')' delimiter 
+    digits = sub_decdigits(status, ctx, buf, 15);
+    return sub_putdec(status, msg, buf, digits);
+}
+
+
+/// Writes a decimal token collected by sub_decdigits()
+static int sub_putdec(int* status, bintex_q* msg, const char* buf, int digits) {
     int     sign    = 1;
     int     force_u = 0;
     int     number  = 0;
     int     i       = 0;
     int     size    = 0;
     
-    // Buffer until whitespace or ')' delimiter 
-    digits = sub_decdigits(status, stream, buf, 15);
+    // Empty token, such as repeated whitespace
+    if (digits == 0) {
+        return 0;
+    }
     
     // Deal with leading minus sign
     if (buf[i] == '-') {
         i++;
         sign = -1;
     }
+    if ((i >= digits) || !IS_DECVAL(buf[i])) {
+        *status = 2;
+        return 0;
+    }
     
     // Go through the digits & footer
     // - load in numerical value, one digit at a time
@@ -726,13 +2002,21 @@ static int sub_getdecnum(int* status, void* stream, bintex_q* msg) {
             force_u = (buf[i] == 'u');
             i      += force_u;
 
-            if (buf[i] == 'c')      size = 1;   // c: char (1 byte)
-            else if (buf[i] == 's') size = 2;   // s: short (2 bytes)
-            else if (buf[i] == 'l') size = 3;   // l: long (4 bytes)
+            if (i < digits) {
+                if (buf[i] == 'c')      size = 1;   // c: char (1 byte)
+                else if (buf[i] == 's') size = 2;   // s: short (2 bytes)
+                else if (buf[i] == 'l') size = 3;   // l: long (4 bytes)
+                i += (size != 0);
+            }
             break;
         }
     }
     
+    // Characters left over after the type footer are not valid
+    if (i != digits) {
+        *status = 2;
+    }
+    
     // Determine size in case where footer is not explicitly provided
     if (size == 0) {
         int j;
@@ -745,6 +2029,10 @@ static int sub_getdecnum(int* status, void* stream, bintex_q* msg) {
     }
 
     number *= sign;
+    if (q_reserve(msg, 4) != 0) {
+        *status = 3;
+        return 0;
+    }
 
     switch (size & 3) {
         case 0:
@@ -763,66 +2051,66 @@ static int sub_getdecnum(int* status, void* stream, bintex_q* msg) {
 }
 
 
-static int sub_hexdigits(int* status, void* stream, char* buf, int limit) {
+static int sub_hexdigits(int* status, bintex_ctx* ctx, char* buf, int limit) {
     int digits;
     digits  = 0;
     *status = 0;
         
     while (digits < limit) {
-        buf[digits] = sub_getc(stream);
-        if (buf[digits] == ']') {
+        int next = sub_getc(ctx);
+        if (next == ']') {
             *status = 1;
             break;
         }
-        if (!IS_HEXVAL(buf[digits])) {
-            if (!IS_WHITESPACE(buf[digits])) {
+        if (!IS_HEXVAL(next)) {
+            if (!IS_WHITESPACE(next)) {
                 *status = 2;
             }
             break;
         }
-        digits++;
+        buf[digits++] = (char)next;
     }
     
     return digits;
 }
 
-static int sub_decdigits(int* status, void* stream, char* buf, int limit) {
+static int sub_decdigits(int* status, bintex_ctx* ctx, char* buf, int limit) {
     int digits;
     digits  = 0;
     *status = 0;
         
     while (digits < limit) {
-        buf[digits] = sub_getc(stream);
-        if (buf[digits] == ')') {
+        int next = sub_getc(ctx);
+        if (next == ')') {
             *status = 1;
             break;
         }
-        if (!IS_DECVAL(buf[digits])) {
-            if (!IS_WHITESPACE(buf[digits])) {
+        if (!IS_DECTOKEN(next)) {
+            if (!IS_WHITESPACE(next)) {
                 *status = 2;
             }
             break;
         }
-        digits++;
+        buf[digits++] = (char)next;
     }
     
     return digits;
 }
 
-static int sub_bindigits(int* status, void* stream, char* buf, int limit) {
+static int sub_bindigits(int* status, bintex_ctx* ctx, char* buf, int limit) {
     int digits;
     digits  = 0;
     *status = 0;
         
     while (digits < limit) {
-        buf[digits] = sub_getc(stream);
-        if (!IS_BINVAL(buf[digits])) {
-            if (!IS_WHITESPACE(buf[digits])) {
+        int next = sub_getc(ctx);
+        if (!IS_BINVAL(next)) {
+            if (!IS_WHITESPACE(next)) {
                 *status = 2;
             }
             break;
         }
-        digits++;
+        buf[digits++] = (char)next;
     }
     
     return digits;
@@ -832,18 +2120,324 @@ static int sub_bindigits(int* status, void* stream, char* buf, int limit) {
 
 
 
+/** Encoder for bintex_emit().
+  * Each function returns the number of characters in its output, and writes
+  * the output only if out is not NULL.  Binary is emitted as a hex block of
+  * one 64 digit token per line, or as a dec block of 16 numbers per line.
+  */
+#ifndef BINTEX_EMIT_MINRUN
+#   define BINTEX_EMIT_MINRUN   8
+#endif
+
+#define IS_EMITASCII(VAL)   ((((VAL)>=' ') && ((VAL)<='~')) || ((VAL)=='\t') || ((VAL)=='\n') || ((VAL)=='\r'))
+
+static size_t sub_emit(char* out, const uint8_t* in, size_t in_len, int flags) {
+    const uint8_t*  end     = in + in_len;
+    const uint8_t*  seg     = in;
+    const uint8_t*  p       = in;
+    size_t          total   = 0;
+    
+    // Binary between ASCII runs is emitted when a run is found, or at the end
+    while (1) {
+        size_t run = 0;
+        
+        if ((flags & BINTEX_EMIT_ASCII) == 0) {
+            p = end;
+        }
+        while (((p+run) < end) && IS_EMITASCII(p[run])) run++;
+        if ((run < BINTEX_EMIT_MINRUN) && (p < end)) {
+            p += (run == 0) ? 1 : run;
+            continue;
+        }
+        
+        if (p != seg) {
+            if (total != 0) {
+                if (out != NULL) out[total] = '\n';
+                total++;
+            }
+            if (flags & (BINTEX_EMIT_DEC8 | BINTEX_EMIT_DEC16)) {
+                total += sub_emitdec((out == NULL) ? NULL : out+total, seg, p-seg, flags);
+            }
+            else {
+                total += sub_emithex((out == NULL) ? NULL : out+total, seg, p-seg);
+            }
+        }
+        if (p == end) {
+            break;
+        }
+        
+        if (total != 0) {
+            if (out != NULL) out[total] = '\n';
+            total++;
+        }
+        total  += sub_emitascii((out == NULL) ? NULL : out+total, p, run);
+        p      += run;
+        seg     = p;
+    }
+    
+    return total;
+}
+
+
+static size_t sub_emitascii(char* out, const uint8_t* in, size_t len) {
+    size_t i;
+    size_t total = 1;
+    
+    for (i=0; i<len; i++) {
+        char c = (char)in[i];
+        char e = 0;
+        
+        switch (c) {
+            case '\\':  e = '\\';  break;
+            case '"':   e = '"';   break;
+            case '\t':  e = 't';   break;
+            case '\n':  e = 'n';   break;
+            case '\r':  e = 'r';   break;
+        }
+        if (e != 0) {
+            if (out != NULL) {
+                out[total]      = '\\';
+                out[total+1]    = e;
+            }
+            total += 2;
+        }
+        else {
+            if (out != NULL) {
+                out[total] = c;
+            }
+            total++;
+        }
+    }
+    
+    if (out != NULL) {
+        out[0]      = '"';
+        out[total]  = '"';
+    }
+    return total + 1;
+}
+
+
+#ifdef BINTEX_SSE2
+static inline __m128i sub_nibascii_sse2(__m128i nib) {
+    __m128i alpha = _mm_cmpgt_epi8(nib, _mm_set1_epi8(9));
+    return _mm_add_epi8( _mm_add_epi8(nib, _mm_set1_epi8('0')), 
+                         _mm_and_si128(alpha, _mm_set1_epi8('A'-'0'-10)) );
+}
+
+static inline void sub_hexencode16_sse2(char* out, const uint8_t* in) {
+    __m128i v   = _mm_loadu_si128((const __m128i*)in);
+    __m128i hi  = _mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0F));
+    __m128i lo  = _mm_and_si128(v, _mm_set1_epi8(0x0F));
+    
+    _mm_storeu_si128((__m128i*)out,      sub_nibascii_sse2(_mm_unpacklo_epi8(hi, lo)));
+    _mm_storeu_si128((__m128i*)(out+16), sub_nibascii_sse2(_mm_unpackhi_epi8(hi, lo)));
+}
+#endif
+
+#ifdef BINTEX_AVX2
+static BINTEX_AVX2_TARGET inline __m256i sub_nibascii_avx2(__m256i nib) {
+    __m256i alpha = _mm256_cmpgt_epi8(nib, _mm256_set1_epi8(9));
+    return _mm256_add_epi8( _mm256_add_epi8(nib, _mm256_set1_epi8('0')), 
+                            _mm256_and_si256(alpha, _mm256_set1_epi8('A'-'0'-10)) );
+}
+
+static BINTEX_AVX2_TARGET size_t sub_hexlines_avx2(char* out, const uint8_t* in, size_t lines) {
+    size_t i;
+    
+    for (i=0; i<lines; i++, in+=32, out+=65) {
+        __m256i v   = _mm256_loadu_si256((const __m256i*)in);
+        __m256i hi  = _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0F));
+        __m256i lo  = _mm256_and_si256(v, _mm256_set1_epi8(0x0F));
+        __m256i a   = _mm256_unpacklo_epi8(hi, lo);
+        __m256i b   = _mm256_unpackhi_epi8(hi, lo);
+        
+        // Unpacking is per 128 bit lane: a holds bytes 0-7 and 16-23, b 8-15 and 24-31
+        _mm256_storeu_si256((__m256i*)out,      sub_nibascii_avx2(_mm256_permute2x128_si256(a, b, 0x20)));
+        _mm256_storeu_si256((__m256i*)(out+32), sub_nibascii_avx2(_mm256_permute2x128_si256(a, b, 0x31)));
+        out[64] = '\n';
+    }
+    return i * 32;
+}
+#endif
+
+
+static size_t sub_emithex(char* out, const uint8_t* in, size_t len) {
+    static const char hexdigit[] = "0123456789ABCDEF";
+    size_t  total;
+    size_t  i;
+    
+    if (len == 0) {
+        return 0;
+    }
+    total = 2 + (2*len) + ((len-1) / 32);
+    if (out == NULL) {
+        return total;
+    }
+    
+    *out++  = '[';
+    i       = 0;
+    
+    // Whole lines of 32 bytes are encoded with the vector paths
+#   ifdef BINTEX_AVX2
+    if (HAS_AVX2()) {
+        i       = sub_hexlines_avx2(out, in, len/32);
+        out    += (i/32) * 65;
+    }
+#   endif
+    for (; (len-i) >= 32; i+=32) {
+#       if defined(BINTEX_SSE2)
+        sub_hexencode16_sse2(out, in+i);
+        sub_hexencode16_sse2(out+32, in+i+16);
+#       else
+        int j;
+        for (j=0; j<32; j++) {
+            out[2*j]    = hexdigit[in[i+j] >> 4];
+            out[2*j+1]  = hexdigit[in[i+j] & 15];
+        }
+#       endif
+        out    += 64;
+        *out++  = '\n';
+    }
+    if (i == len) {
+        out--;
+    }
+    for (; i<len; i++) {
+        *out++  = hexdigit[in[i] >> 4];
+        *out++  = hexdigit[in[i] & 15];
+    }
+    *out = ']';
+    
+    return total;
+}
+
+
+static size_t sub_emitdec(char* out, const uint8_t* in, size_t len, int flags) {
+    size_t  total = 1;
+    size_t  i;
+    int     n;
+    
+    // Values that need a type footer to be read back at their size get one:
+    // bytes above 128 take "u", and 16 bit numbers always take "us".
+    for (i=0, n=0; i<len; n++) {
+        char        buf[8];
+        char*       cursor = &buf[sizeof(buf)];
+        unsigned    value;
+        
+        if ((flags & BINTEX_EMIT_DEC16) && ((len-i) >= 2)) {
+            value       = ((unsigned)in[i] << 8) | in[i+1];
+            i          += 2;
+            *--cursor   = 's';
+            *--cursor   = 'u';
+        }
+        else {
+            value       = in[i++];
+            if (value > 128) {
+                *--cursor = 'u';
+            }
+        }
+        do {
+            *--cursor   = '0' + (value % 10);
+            value      /= 10;
+        } while (value != 0);
+        
+        if (out != NULL) {
+            out[total-1] = (n == 0) ? '(' : ((n % 16) == 0) ? '\n' : ' ';
+            memcpy(&out[total], cursor, &buf[sizeof(buf)] - cursor);
+        }
+        total += 1 + (&buf[sizeof(buf)] - cursor);
+    }
+    
+    if (out != NULL) {
+        out[total-1] = ')';
+    }
+    return total;
+}
+
+
+
+
 /** Internal Queue Module Implementation.
     Could be broken into separate files
  */
 
-static void q_init(bintex_q* q, uint8_t* buffer, uint16_t alloc) {
+static void q_init(bintex_q* q, uint8_t* buffer, size_t alloc) {
     q->alloc    = alloc;
     q->front    = buffer;
     q->back     = buffer+alloc;
+    q->overflow = NULL;
+    q->ext      = NULL;
+    q->allocf   = NULL;
     q_empty(q);
 }
 
 
+/** Called by the parser before each write, with the number of bytes it is 
+  * about to write.  The overflow handler of the queue is invoked when there 
+  * isn't room for them.  BINTEX_FULL is returned if there is still no room,
+  * and then nothing may be written.
+  */
+static inline int q_reserve(bintex_q* q, size_t need) {
+    PROBE2(q_reserve, q, need);
+    if ((size_t)(q->back - q->putcursor) < need) {
+        if ((q->overflow == NULL) || (q->overflow(q, need) != 0)) {
+            PROBE2(q_full, q, need);
+            return BINTEX_FULL;
+        }
+    }
+    return 0;
+}
+
+
+/// Overflow handler of a counting queue: data is discarded, only the sizes
+/// returned by the parser are used.
+static int q_discard(bintex_q* q, size_t need) {
+    (void)need;
+    q->putcursor = q->front;
+    return 0;
+}
+
+
+/// Overflow handler of a growable queue: the allocation is at least doubled,
+/// and the cursors are moved to the new buffer at the same offsets.
+static int q_grow(bintex_q* q, size_t need) {
+    size_t      length;
+    size_t      alloc;
+    uint8_t*    buffer;
+    
+    length  = q_length(q);
+    alloc   = (q->alloc < 64) ? 64 : q->alloc;
+    while ((alloc - length) < need) {
+        if (alloc > (SIZE_MAX / 2)) {
+            return -1;
+        }
+        alloc *= 2;
+    }
+    buffer = q->allocf(q->ext, q->front, q->alloc, alloc);
+    if (buffer == NULL) {
+        return -1;
+    }
+    
+    q->getcursor    = buffer + (q->getcursor - q->front);
+    q->putcursor    = buffer + length;
+    q->front        = buffer;
+    q->back         = buffer + alloc;
+    q->alloc        = alloc;
+    return 0;
+}
+
+
+/// Default allocator of growable queues
+static void* q_stdalloc(void* ud, void* ptr, size_t osize, size_t nsize) {
+    (void)ud;
+    (void)osize;
+    if (nsize == 0) {
+        free(ptr);
+        return NULL;
+    }
+    return realloc(ptr, nsize);
+}
+
+
 
 static void q_rebase(bintex_q *q, uint8_t* buffer) {
     q->front        = buffer;
@@ -858,16 +2452,16 @@ static void q_copy(bintex_q* q1, bintex_q* q2) {
 }
 
 
-static int16_t q_length(bintex_q* q) {
-    return (q->putcursor - q->front);
+static size_t q_length(bintex_q* q) {
+    return (size_t)(q->putcursor - q->front);
 }
 
-static int16_t q_span(bintex_q* q) {
-    return (q->putcursor - q->getcursor);
+static size_t q_span(bintex_q* q) {
+    return (size_t)(q->putcursor - q->getcursor);
 }
 
-static int16_t q_space(bintex_q* q) {
-    return (q->back - q->putcursor);
+static size_t q_space(bintex_q* q) {
+    return (size_t)(q->back - q->putcursor);
 }
 
 
@@ -883,7 +2477,7 @@ static void q_empty(bintex_q* q) {
 
 
 
-static uint8_t* q_start(bintex_q* q, int offset, uint16_t options) {  
+static uint8_t* q_start(bintex_q* q, size_t offset, uint16_t options) {  
     q_empty(q);
 
     if (offset >= q->alloc) 
@@ -1024,14 +2618,14 @@ static uint32_t q_readlong(bintex_q* q)  {
 }
 
 
-static void q_writestring(bintex_q* q, uint8_t* string, int length) {
+static void q_writestring(bintex_q* q, uint8_t* string, size_t length) {
     memcpy(q->putcursor, string, length);
     //#q->length      += length;
     q->putcursor   += length;
 }
 
 
-static void q_readstring(bintex_q* q, uint8_t* string, int length) {
+static void q_readstring(bintex_q* q, uint8_t* string, size_t length) {
     memcpy(string, q->getcursor, length);
     q->getcursor += length;
 }
@@ -1042,19 +2636,19 @@ static void q_readstring(bintex_q* q, uint8_t* string, int length) {
 #include <stdio.h>
 
 static void q_print(bintex_q* q) {
-    int length;
-    int i;
-    int row;
-    length = q_length(q);
+    ptrdiff_t length;
+    size_t i;
+    size_t row;
+    length = (ptrdiff_t)q_length(q);
     
-    printf("Queue Length/Alloc: %d/%d\n", length, q->alloc);
-    printf("Queue Getcursor:    %d\n", (int)(q->getcursor-q->front));
-    printf("Queue Putcursor:    %d\n", (int)(q->putcursor-q->front));
+    printf("Queue Length/Alloc: %td/%zu\n", length, q->alloc);
+    printf("Queue Getcursor:    %td\n", q->getcursor-q->front);
+    printf("Queue Putcursor:    %td\n", q->putcursor-q->front);
     
     for (i=0, row=0; length>0; ) {
         length -= 8;
         row    += (length>0) ? 8 : 8+length;
-        printf("%04X: ", i);
+        printf("%04zX: ", i);
         for (; i<row; i++) {
             printf("%02X ", q->front[i]);
         }
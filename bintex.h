@@ -74,6 +74,8 @@
   * Multiple data expressions: <BR>
   * Multiple data expressions are bounded by open and close characters (such as
   * [], (), and "").  Whitespace can exist inside the open and close characters.
+  * If a [] or () block contains an invalid character, or is not closed, no 
+  * data is output for the block and the parser returns BINTEX_ERROR.
   * 
   * 1. Multiple Hex expression: <BR>
   * Use the square brackets [] to enclose one or more hex sequences.  Inside the 
@@ -99,84 +101,490 @@ extern "C" {
 #endif
 
 #include <stdio.h>
+#include <stdarg.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <sys/types.h>
 
 
 //#define __DEBUG__
 
 
 
+/** @typedef bintex_alloc
+  *
+  * Allocator used by growable queues.  It has the same contract as the 
+  * allocator of Lua: with nsize == 0 it frees ptr and returns NULL, otherwise
+  * it returns a block of nsize bytes holding the first min(osize, nsize) bytes
+  * of ptr (which may be NULL), or NULL if the allocation fails, in which case 
+  * ptr is left as it was.  ud is the user pointer given to the queue.
+  */
+typedef void* (*bintex_alloc)(void* ud, void* ptr, size_t osize, size_t nsize);
+
+
+
 /** @typedef Queue
   * 
   * The Queue data type does not contain the data in the queues themselves, just
   * information on how to get that data as well as any other useful variables.
   *
-  * uint16_t alloc        Allocation of the queue data, in bytes
+  * size_t alloc          Allocation of the queue data, in bytes
   *
-  * uint16_t length       The current extent of the queue data, in bytes
   * Twobytes options    User flags
   * uint8_t* front        First address of queue data
   * uint8_t* back         Used for boundary checking (user adjustable)
   * uint8_t* getcursor    Cursor address for reading from queue
   * uint8_t* putcursor    Cursor address for writing to queue
+  * overflow              Optional handler, called when a write needs more
+  *                       bytes than remain between putcursor and back.  It 
+  *                       returns 0 when it has made room, or negative.
+  * void* ext             Data for the overflow handler
+  * allocf                Allocator of a growable queue, else NULL
+  *
+  * Initialize queues with bintex_q_init(), which clears the optional fields,
+  * or with bintex_q_init_grow() for a queue that grows as it is written.
   */
-typedef struct {
-    int         alloc;
+typedef struct bintex_q {
+    size_t      alloc;
     uint16_t    options;
     uint8_t*    getcursor;
     uint8_t*    putcursor;
     uint8_t*    front;
     uint8_t*    back;
+    int         (*overflow)(struct bintex_q* q, size_t need);
+    void*       ext;
+    bintex_alloc allocf;
 } bintex_q;
 
 
 
+/** @brief  Initialize a Queue over a caller-supplied buffer
+  * @param  q           (bintex_q*) queue to initialize
+  * @param  buffer      (uint8_t*) queue data buffer
+  * @param  alloc       (size_t) allocated bytes of buffer
+  * @retval None
+  * @ingroup BinTex
+  */
+void bintex_q_init(bintex_q* q, uint8_t* buffer, size_t alloc);
+
+
+
+/** @brief  Initialize a growable Queue, which allocates its own buffer
+  * @param  q           (bintex_q*) queue to initialize
+  * @param  alloc       (size_t) initial allocation, in bytes.  May be 0.
+  * @param  allocf      (bintex_alloc) allocator, or NULL to use realloc()
+  * @param  ud          (void*) user pointer passed to allocf
+  * @retval (int)       0 on success, or BINTEX_ERROR if allocation failed
+  * @ingroup BinTex
+  * @sa bintex_q_free()
+  *
+  * When a write needs more room than is left in the queue, the allocation is
+  * doubled (or more, as needed) through allocf, so input of unknown size can
+  * be parsed in one pass.  Data moves when the queue grows, so pointers into
+  * the queue must be re-read from q->front after parsing.  If the allocator
+  * fails, the parser returns BINTEX_FULL, as it does for a fixed queue.
+  */
+int bintex_q_init_grow(bintex_q* q, size_t alloc, bintex_alloc allocf, void* ud);
+
+
+
+/** @brief  Free the buffer of a growable Queue
+  * @param  q           (bintex_q*) queue initialized by bintex_q_init_grow()
+  * @retval None
+  * @ingroup BinTex
+  */
+void bintex_q_free(bintex_q* q);
+
+
+
+/** @brief Return codes from the parser functions
+  * Iterative functions return one of these after the last expression has been
+  * parsed.  They are also stored in bintex_ctx.error.
+  */
+#define BINTEX_EOF          (-1)
+#define BINTEX_ERROR        (-2)
+#define BINTEX_LINETERM     (-3)
+#define BINTEX_FULL         (-4)
+
+
+
+/** @note Output bounds
+  * Each expression reserves room in the output before it is written.  If the
+  * output is full, nothing of the expression is output and BINTEX_FULL is 
+  * returned, with the input left at the start of the expression.  The caller
+  * can then flush or enlarge the output and call again to resume parsing.  
+  * An expression that is larger than the whole output never fits.  Input
+  * read by bintex_iter_fq(), which is unbuffered, can't be rewound, so the
+  * expression is lost in that case.
+  *
+  * The functions that parse a whole input into a buffer (bintex_fs(), 
+  * bintex_ss(), bintex_sn(), bintex_fd(), bintex_path(), bintex_par_sn() and
+  * their "_r" variants) return BINTEX_FULL when the output is full.  The 
+  * expressions that fit are left in the output.  Parsing that stops at an 
+  * error or a ';' returns the number of bytes output before it, and the "_r"
+  * variants give the reason in ctx->error.
+  */
+
+
+
+/** @typedef bintex_stats
+  *
+  * Parser counters, one set per expression type as dispatched by the parser:
+  *
+  * exprs           Number of expressions parsed
+  * in_bytes        Input consumed, from the start of each expression to where
+  *                 parsing stopped, including whitespace before it.  Input
+  *                 read by bintex_iter_fq(), which is unbuffered, is not counted.
+  * out_bytes       Output written
+  * cycles          Time spent, in TSC ticks on x86, else in nanoseconds
+  *
+  * The counters are only kept by a library built with __BINTEX_STATS__.
+  */
+#define BINTEX_STAT_EOF         0
+#define BINTEX_STAT_ERROR       1
+#define BINTEX_STAT_LINETERM    2
+#define BINTEX_STAT_COMMENT     3
+#define BINTEX_STAT_ASCII       4
+#define BINTEX_STAT_BINNUM      5
+#define BINTEX_STAT_HEXNUM      6
+#define BINTEX_STAT_HEXBLOCK    7
+#define BINTEX_STAT_DECNUM      8
+#define BINTEX_STAT_DECBLOCK    9
+#define BINTEX_STAT_SLOT        10
+#define BINTEX_STAT_TYPES       11
+
+typedef struct {
+    uint64_t        exprs;
+    uint64_t        in_bytes;
+    uint64_t        out_bytes;
+    uint64_t        cycles;
+} bintex_stat;
+
+typedef struct {
+    bintex_stat     type[BINTEX_STAT_TYPES];
+} bintex_stats;
+
+
+
+/** @typedef bintex_ctx
+  *
+  * Parser context.  All of the state used by the parser during a call lives in
+  * this object, so separate contexts may be used concurrently from separate
+  * threads.  Initialize it with bintex_ctx_init() and pass it to the "_r"
+  * variants of the parser functions.
+  *
+  * readc           Input reader, set by the function that binds the input
+  * file            Input file, when parsing from a FILE*
+  * cursor          Input cursor, in a string or in the file read block
+  * end             End of string input (NULL if NUL-terminated) or of read block
+  * mark            Start of the expression being parsed, kept in the block so
+  *                 the input can be rewound when the output is full
+  * block           File read block, allocated when a file is first bound
+  * blocksize       Allocated size of the file read block
+  * fd              Input file descriptor, when parsing from a descriptor
+  * eof             Set when the file has no more data to read into the block
+  * error           Return code of the most recent parsing call
+  *
+  * The push parser (bintex_feed()) keeps its state between chunks of input in
+  * these fields:
+  * msg             Output queue, bound by bintex_push_init()
+  * state           Expression or token being parsed
+  * toklen          Number of characters in tok
+  * pmark           Output offset in msg where the current expression started
+  * tok             Characters of the token being parsed
+  *
+  * slots           Set by bintex_tpl_compile(), so that '%' starts a slot
+  * stats           Counters for this context, or NULL to count into those of
+  *                 the calling thread.  Set it after bintex_ctx_init().
+  */
+typedef struct bintex_ctx {
+    int             (*readc)(struct bintex_ctx* ctx);
+    FILE*           file;
+    const unsigned char* cursor;
+    const unsigned char* end;
+    const unsigned char* mark;
+    unsigned char*  block;
+    size_t          blocksize;
+    int             fd;
+    int             eof;
+    int             error;
+    bintex_q*       msg;
+    int             state;
+    int             toklen;
+    size_t          pmark;
+    char            tok[64];
+    int             slots;
+    bintex_stats*   stats;
+} bintex_ctx;
+
+
+
+/** @brief  Initialize a parser context
+  * @param  ctx         (bintex_ctx*) context to initialize
+  * @retval None
+  * @ingroup BinTex
+  */
+void bintex_ctx_init(bintex_ctx* ctx);
+
+
+
+/** @brief  Free resources held by a parser context, and re-initialize it
+  * @param  ctx         (bintex_ctx*) context to free
+  * @retval None
+  * @ingroup BinTex
+  *
+  * Contexts used for file input hold a read block, which is kept between calls
+  * so it can be reused.  Call this when finished with such a context.
+  */
+void bintex_ctx_free(bintex_ctx* ctx);
+
+
+
 
 /** @brief  Parse a complete Bintex File, outputting binary to stream
   * @param  file        (FILE*) input file, nominally encoded as UTF-8
   * @param  stream_out  (unsigned char*) byte-wise, binary output stream
-  * @param  size        (int) allocation limit of stream_out
-  * @retval (int)       negative on error, else number of bytes output to stream
+  * @param  size        (size_t) allocation limit of stream_out
+  * @retval (ssize_t)   negative on error, else number of bytes output to stream
   * @ingroup BinTex
   * @sa bintex_ss()
+  *
+  * Parsing ends at EOF, an error or a ';'.  The file is left just past the
+  * input that was parsed, as described for bintex_fs_r().  On a stream that
+  * can't seek, input read past a ';' or an error is discarded, so use
+  * bintex_fs_r() to parse several messages from a pipe.
   */
-int bintex_fs(FILE* file, unsigned char* stream_out, int size);
+ssize_t bintex_fs(FILE* file, unsigned char* stream_out, size_t size);
 
 
 
 /** @brief  Parse a complete Bintex null-terminated string, outputting binary to stream
   * @param  string      (unsigned char*) input string
   * @param  stream_out  (unsigned char*) byte-wise, binary output stream
-  * @param  size        (int) allocation limit of stream_out
-  * @retval (int)       negative on error, else number of bytes output to stream
+  * @param  size        (size_t) allocation limit of stream_out
+  * @retval (ssize_t)   negative on error, else number of bytes output to stream
   * @ingroup BinTex
   * @sa bintex_fs()
   *
   * @note bintex_ss() will increment the string pointer (*string)
   */
-int bintex_ss(unsigned char* string, unsigned char* stream_out, int size);
+ssize_t bintex_ss(unsigned char* string, unsigned char* stream_out, size_t size);
+
+
+
+/** @brief  Parse a complete Bintex string of known length, outputting binary to stream
+  * @param  in          (const uint8_t*) input string, need not be NUL-terminated
+  * @param  in_len      (size_t) length of input string
+  * @param  out         (uint8_t*) byte-wise, binary output stream
+  * @param  out_len     (size_t) allocation limit of out
+  * @retval (ssize_t)   negative on error, else number of bytes output to stream
+  * @ingroup BinTex
+  * @sa bintex_ss()
+  *
+  * Parsing stops after in_len bytes, or at a NUL if one comes first, so input
+  * can be parsed directly from receive buffers and slices of larger buffers.
+  */
+ssize_t bintex_sn(const uint8_t* in, size_t in_len, uint8_t* out, size_t out_len);
+
+
+
+/** @brief  Parse a complete Bintex string of known length, appending to a Queue
+  * @param  in          (const uint8_t*) input string, need not be NUL-terminated
+  * @param  in_len      (size_t) length of input string
+  * @param  msg         (Queue*) output Queue, which is normally growable
+  * @retval (ssize_t)   number of bytes appended to msg
+  * @ingroup BinTex
+  * @sa bintex_sn(), bintex_q_init_grow()
+  *
+  * With a growable queue, the output never overflows and doesn't need to be
+  * sized beforehand.  The output starts at msg->putcursor.
+  */
+ssize_t bintex_snq(const uint8_t* in, size_t in_len, bintex_q* msg);
+
+
+
+/** @brief  Compute the exact output size of a Bintex string, without writing it
+  * @param  in          (const uint8_t*) input string, need not be NUL-terminated
+  * @param  in_len      (size_t) length of input string
+  * @param  sizes       (size_t*) optional array that receives the size of each 
+  *                     expression, in order.  May be NULL.
+  * @param  count       (size_t*) optional.  On input, the number of elements in 
+  *                     sizes.  On output, the number of expressions parsed, 
+  *                     which may exceed the input value.
+  * @retval (ssize_t)   number of bytes that bintex_sn() would output
+  * @ingroup BinTex
+  * @sa bintex_sn()
+  *
+  * The input is run through the parser with a counting sink instead of an
+  * output buffer, so the output can be allocated once at its exact size.  The
+  * expression sizes are the values that bintex_iter_snq() would return, so an
+  * expression that outputs nothing (e.g. a comment) has a size of 0.
+  */
+ssize_t bintex_measure(const uint8_t* in, size_t in_len, size_t* sizes, size_t* count);
+
+
+
+/** @brief  Options for bintex_emit()
+  * BINTEX_EMIT_ASCII:  Printable runs of BINTEX_EMIT_MINRUN (8) or more 
+  *                     characters are emitted as quoted strings.
+  * BINTEX_EMIT_DEC8:   Binary is emitted as a dec block of unsigned bytes,
+  *                     instead of as a hex block.
+  * BINTEX_EMIT_DEC16:  Binary is emitted as a dec block of big-endian 16 bit
+  *                     numbers, with a byte at the end if the length is odd.
+  */
+#define BINTEX_EMIT_ASCII   1
+#define BINTEX_EMIT_DEC8    2
+#define BINTEX_EMIT_DEC16   4
+
+
+
+/** @brief  Encode binary as Bintex, the inverse of bintex_sn()
+  * @param  in          (const uint8_t*) binary input
+  * @param  in_len      (size_t) length of input
+  * @param  out         (char*) text output, or NULL to compute its size
+  * @param  out_len     (size_t) allocation limit of out
+  * @param  flags       (int) BINTEX_EMIT_... options, or 0
+  * @retval (ssize_t)   number of characters output, or BINTEX_FULL if the
+  *                     output doesn't fit in out_len.
+  * @ingroup BinTex
+  * @sa bintex_sn()
+  *
+  * By default the output is a single hex block in uppercase, with 32 bytes
+  * on each line.  The output is not NUL-terminated.  When out is NULL, the
+  * return value is the size of the output, which is computed without 
+  * encoding it unless BINTEX_EMIT_ASCII is used.  Parsing the output with 
+  * bintex_sn() gives back the input.
+  */
+ssize_t bintex_emit(const uint8_t* in, size_t in_len, char* out, size_t out_len, int flags);
+
+
+
+/** @brief  Parse a complete Bintex file by path, outputting binary to stream
+  * @param  path        (const char*) path of input file
+  * @param  stream_out  (unsigned char*) byte-wise, binary output stream
+  * @param  size        (size_t) allocation limit of stream_out
+  * @retval (ssize_t)   negative on error, else number of bytes output to stream
+  * @ingroup BinTex
+  * @sa bintex_fd()
+  *
+  * The file is memory-mapped and parsed with the same buffer parser used by
+  * bintex_ss(), which is much faster than the per-character reads done by
+  * bintex_fs().  Available on POSIX systems.
+  */
+ssize_t bintex_path(const char* path, unsigned char* stream_out, size_t size);
+
+
+
+/** @brief  Parse a complete Bintex file descriptor, outputting binary to stream
+  * @param  fd          (int) input file descriptor
+  * @param  stream_out  (unsigned char*) byte-wise, binary output stream
+  * @param  size        (size_t) allocation limit of stream_out
+  * @retval (ssize_t)   negative on error, else number of bytes output to stream
+  * @ingroup BinTex
+  * @sa bintex_path()
+  *
+  * Parsing starts at the current file offset, and the offset is left after the
+  * last character parsed.  Regular files are memory-mapped.  Other types of 
+  * descriptor (pipes, sockets) are read in blocks.
+  */
+ssize_t bintex_fd(int fd, unsigned char* stream_out, size_t size);
+
+
+
+/** @brief  Parse a complete Bintex string on multiple threads
+  * @param  in          (const uint8_t*) input string, need not be NUL-terminated
+  * @param  in_len      (size_t) length of input string
+  * @param  out         (uint8_t*) byte-wise, binary output stream
+  * @param  out_len     (size_t) allocation limit of out
+  * @param  threads     (int) number of threads to use, or 0 for one per CPU
+  * @retval (ssize_t)   negative on error, else number of bytes output to stream
+  * @ingroup BinTex
+  * @sa bintex_sn()
+  *
+  * The input is split after the first newline past each chunk size, the 
+  * chunks are parsed by a pool of threads into their own growable queues, and
+  * the queues are copied to out in order.  A split that falls inside a string
+  * or block is found when its chunk ends in an error at the split, and that
+  * chunk is parsed again together with the ones after it.  The output is the
+  * same as that of bintex_sn().  Inputs smaller than BINTEX_MT_MINSIZE (1 MiB)
+  * are parsed on the calling thread.  Available on POSIX systems.
+  */
+ssize_t bintex_par_sn(const uint8_t* in, size_t in_len, uint8_t* out, size_t out_len, int threads);
+
+
+
+/** @brief  Parse a complete Bintex file by path, on multiple threads
+  * @param  path        (const char*) path of input file
+  * @param  out         (uint8_t*) byte-wise, binary output stream
+  * @param  out_len     (size_t) allocation limit of out
+  * @param  threads     (int) number of threads to use, or 0 for one per CPU
+  * @retval (ssize_t)   negative on error, else number of bytes output to stream
+  * @ingroup BinTex
+  * @sa bintex_par_sn(), bintex_path()
+  *
+  * The file is memory-mapped and parsed with bintex_par_sn().  Files that
+  * can't be mapped are parsed with bintex_fd().
+  */
+ssize_t bintex_par_path(const char* path, uint8_t* out, size_t out_len, int threads);
+
+
+
+/** @brief  Parse many Bintex strings into one output buffer
+  * @param  in          (const uint8_t* const*) array of input strings
+  * @param  in_len      (const size_t*) array of input lengths, or NULL if the
+  *                     inputs are NUL-terminated
+  * @param  count       (size_t) number of inputs
+  * @param  out         (uint8_t*) byte-wise, binary output stream
+  * @param  out_len     (size_t) allocation limit of out
+  * @param  offsets     (size_t*) receives the offset in out of each output
+  * @param  lengths     (size_t*) receives the length of each output
+  * @param  status      (int*) optional.  Receives the code that ended the 
+  *                     parsing of each input, as in bintex_ctx.error.
+  * @param  threads     (int) number of threads to use, or 0 for one per CPU
+  * @retval (ssize_t)   number of inputs whose output is in out
+  * @ingroup BinTex
+  * @sa bintex_sn()
+  *
+  * Each input is parsed as by bintex_sn(), and the outputs are placed one 
+  * after another in out, in input order.  Threads claim inputs in blocks of
+  * BINTEX_BATCH_BLOCK, so busy threads are not held up by slow inputs, and
+  * parse them into their own queues, which are then gathered into out.
+  * Small batches are parsed on the calling thread, straight into out.
+  *
+  * If out fills up, the input that doesn't fit and those after it are not
+  * output, and the return value is less than count.
+  */
+ssize_t bintex_batch(const uint8_t* const* in, const size_t* in_len, size_t count,
+                     uint8_t* out, size_t out_len, size_t* offsets, size_t* lengths,
+                     int* status, int threads);
 
 
 
 /** @brief  Iteratively parses a Bintex File, outputting to persistent Queue
   * @param  file        (FILE*) input file, nominally encoded as UTF-8
   * @param  msg         (Queue*) output Queue of binary datastream
-  * @retval (int)       negative on error, else number of bytes written to queue
+  * @retval (ssize_t)   negative on error, else number of bytes written to queue
   * @ingroup BinTex
   * @sa bintex_iter_sq
   *
   * This function is different from bintex_fs() because it will return after
   * parsing each input BinTex expression in the file.  The File and Queue 
   * objects should be retained by the caller/user.
+  *
+  * There is no context to keep read-ahead between calls, so the file is read
+  * a byte at a time with fgetc().  bintex_iter_fq_r() reads in blocks, and is
+  * much faster on pipes.
   */
-int bintex_iter_fq(FILE* file, bintex_q* msg);
+ssize_t bintex_iter_fq(FILE* file, bintex_q* msg);
 
 
 
 /** @brief  Iteratively parses a Bintex null-terminated string, outputting to persistent Queue
   * @param  string      (unsigned char**) input string handle
   * @param  msg         (Queue*) output Queue of binary datastream
-  * @retval (int)       negative on error, else number of bytes written to queue
+  * @param  size        (size_t) maximum number of bytes to write to msg, or 0 
+  *                     for no limit other than the space in msg
+  * @retval (ssize_t)   negative on error, else number of bytes written to queue
   * @ingroup BinTex
   * @sa bintex_iter_fq
   *
@@ -184,7 +592,383 @@ int bintex_iter_fq(FILE* file, bintex_q* msg);
   * parsing each input BinTex expression in the input string.  The String and 
   * Queue objects should be retained by the caller/user.
   */
-int bintex_iter_sq(unsigned char** string, bintex_q* msg, int size);
+ssize_t bintex_iter_sq(unsigned char** string, bintex_q* msg, size_t size);
+
+
+
+/** @brief  Iteratively parses a Bintex string of known length, outputting to persistent Queue
+  * @param  in          (const uint8_t**) input string handle
+  * @param  in_len      (size_t*) remaining length of input string
+  * @param  msg         (Queue*) output Queue of binary datastream
+  * @retval (ssize_t)   negative on error, else number of bytes written to queue
+  * @ingroup BinTex
+  * @sa bintex_iter_sq, bintex_sn
+  *
+  * The length-bounded equivalent of bintex_iter_sq().  *in is advanced past
+  * the parsed expression and *in_len is reduced by the same amount.
+  */
+ssize_t bintex_iter_snq(const uint8_t** in, size_t* in_len, bintex_q* msg);
+
+
+
+/** @brief  Bind an output queue to a context, for push parsing
+  * @param  ctx         (bintex_ctx*) parser context, initialized by bintex_ctx_init()
+  * @param  msg         (Queue*) output Queue of binary datastream
+  * @retval None
+  * @ingroup BinTex
+  * @sa bintex_feed(), bintex_finish()
+  */
+void bintex_push_init(bintex_ctx* ctx, bintex_q* msg);
+
+
+
+/** @brief  Push a chunk of Bintex input into the parser
+  * @param  ctx         (bintex_ctx*) context bound by bintex_push_init()
+  * @param  chunk       (const uint8_t*) input chunk
+  * @param  len         (size_t) length of chunk
+  * @retval (ssize_t)   negative on error, else number of bytes output to the queue
+  * @ingroup BinTex
+  * @sa bintex_finish()
+  *
+  * Input may be split anywhere, even inside a token or escape sequence: the
+  * parser keeps its state in the context and continues with the next chunk.
+  * Output is written as soon as each token is complete, so it doesn't wait 
+  * for the end of the message.  The output of a block or string that turns
+  * out to be invalid is removed from the queue.
+  *
+  * The call stops early with BINTEX_LINETERM after a ';', BINTEX_ERROR after
+  * invalid input, or BINTEX_FULL when the queue is full.  ctx->cursor then 
+  * points to the first character of chunk that was not used, which is where
+  * to continue.  After BINTEX_FULL, empty the queue before continuing; the
+  * output of the expression in progress can then no longer be removed.
+  *
+  * Unlike string input, NUL is an ordinary character, as it is in files.
+  */
+ssize_t bintex_feed(bintex_ctx* ctx, const uint8_t* chunk, size_t len);
+
+
+
+/** @brief  End the input to the push parser
+  * @param  ctx         (bintex_ctx*) context bound by bintex_push_init()
+  * @retval (ssize_t)   negative on error, else number of bytes output to the queue
+  * @ingroup BinTex
+  * @sa bintex_feed()
+  *
+  * A number at the end of the input is output.  An unterminated block or 
+  * string is removed and BINTEX_ERROR is returned.  The context is then ready
+  * for new input.
+  */
+ssize_t bintex_finish(bintex_ctx* ctx);
+
+
+
+/** @typedef bintex_tpl
+  *
+  * Compiled template.  A template is Bintex with slots in it, which are filled
+  * in when it is rendered, so a message that is sent many times with a few
+  * values changed is parsed only once.  A slot is written where an expression
+  * can start, as '%', an optional {name} of up to 15 characters, and a type:
+  *
+  * %c %s %l        1, 2 or 4 byte number, big-endian like a dec token.  A 'u'
+  *                 may be written before the type, as in %us.
+  * %xN             N bytes, copied from bintex_val.data (e.g. %x16)
+  * %a              Any number of bytes: bintex_val.len bytes from .data
+  *
+  * For example: [0A 01] %{seq}s "name:" %a
+  *
+  * frame           Output of the template, with zeros in place of the fixed
+  *                 size slots.  Variable slots take no room in the frame.
+  * frame_len       Length of frame
+  * slot            Slots, in order.  Their offsets are in frame.
+  * slots           Number of slots
+  */
+#define BINTEX_SLOTNAME     16
+
+#define BINTEX_SLOT_NUM     0
+#define BINTEX_SLOT_BYTES   1
+#define BINTEX_SLOT_VAR     2
+
+typedef struct {
+    uint32_t        offset;
+    uint16_t        size;
+    uint8_t         type;
+    uint8_t         rfu;
+    char            name[BINTEX_SLOTNAME];
+} bintex_slot;
+
+typedef struct {
+    uint8_t*        frame;
+    size_t          frame_len;
+    bintex_slot*    slot;
+    size_t          slots;
+} bintex_tpl;
+
+/// Value of a slot: num for a number slot, data (and len for %a) otherwise
+typedef struct {
+    uint32_t        num;
+    const void*     data;
+    size_t          len;
+} bintex_val;
+
+
+
+/** @brief  Compile a template
+  * @param  tpl         (bintex_tpl*) receives the template
+  * @param  in          (const uint8_t*) template text, need not be NUL-terminated
+  * @param  in_len      (size_t) length of template text
+  * @retval (int)       0 on success, or BINTEX_ERROR if the text is invalid or
+  *                     memory can't be allocated
+  * @ingroup BinTex
+  * @sa bintex_tpl_render(), bintex_tpl_free()
+  *
+  * The text is parsed as by bintex_sn(), up to its end or the first ';'.
+  */
+int bintex_tpl_compile(bintex_tpl* tpl, const uint8_t* in, size_t in_len);
+
+
+
+/** @brief  Look up a named slot
+  * @param  tpl         (const bintex_tpl*) compiled template
+  * @param  name        (const char*) slot name, without braces
+  * @retval (int)       index of the slot, or BINTEX_ERROR if there is none
+  * @ingroup BinTex
+  */
+int bintex_tpl_find(const bintex_tpl* tpl, const char* name);
+
+
+
+/** @brief  Render a template with values for its slots
+  * @param  tpl         (const bintex_tpl*) compiled template
+  * @param  vals        (const bintex_val*) one value per slot, in slot order
+  * @param  out         (uint8_t*) byte-wise, binary output
+  * @param  out_len     (size_t) allocation limit of out
+  * @retval (ssize_t)   number of bytes output, or BINTEX_FULL if the output 
+  *                     doesn't fit, in which case nothing is output
+  * @ingroup BinTex
+  *
+  * No parsing is done: the frame is copied and the values are written in.
+  */
+ssize_t bintex_tpl_render(const bintex_tpl* tpl, const bintex_val* vals, uint8_t* out, size_t out_len);
+
+
+
+/** @brief  Free the memory of a compiled template
+  * @param  tpl         (bintex_tpl*) compiled template
+  * @retval None
+  * @ingroup BinTex
+  */
+void bintex_tpl_free(bintex_tpl* tpl);
+
+
+
+/** @typedef bintex_img
+  *
+  * Image of compiled templates, made by bintex_img_write().  An image is used
+  * in place, so loading one from a file is an mmap and a check of its tables.
+  * The layout is described in bintex_img.c.  The image version changes when
+  * the layout or bintex_slot changes, and older images are then refused.
+  *
+  * base            Start of the image, 8 byte aligned
+  * size            Size of the image
+  * count           Number of templates
+  * map_len         Length of the file mapping, if loaded by bintex_img_load()
+  */
+#define BINTEX_IMG_VERSION  1
+#define BINTEX_IMGNAME      32
+
+typedef struct {
+    const uint8_t*  base;
+    size_t          size;
+    size_t          count;
+    size_t          map_len;
+} bintex_img;
+
+
+
+/** @brief  Serialize compiled templates into an image
+  * @param  tpls        (const bintex_tpl*) array of compiled templates
+  * @param  names       (const char* const*) optional array of template names,
+  *                     of up to 31 characters.  May be NULL.
+  * @param  count       (size_t) number of templates
+  * @param  out         (uint8_t*) output, 8 byte aligned, or NULL to compute 
+  *                     the size of the image
+  * @param  out_len     (size_t) allocation limit of out
+  * @retval (ssize_t)   size of the image, or BINTEX_FULL if it doesn't fit
+  * @ingroup BinTex
+  * @sa bintex_img_open(), bintex_img_load()
+  */
+ssize_t bintex_img_write(const bintex_tpl* tpls, const char* const* names, size_t count, uint8_t* out, size_t out_len);
+
+
+
+/** @brief  Open an image that is in memory
+  * @param  img         (bintex_img*) receives the image
+  * @param  data        (const void*) image data, 8 byte aligned
+  * @param  len         (size_t) length of data
+  * @retval (int)       0 on success, or BINTEX_ERROR if the image is invalid,
+  *                     of another version, or from a machine of other byte order
+  * @ingroup BinTex
+  *
+  * Nothing is copied, so data must remain valid while the image is used.
+  */
+int bintex_img_open(bintex_img* img, const void* data, size_t len);
+
+
+
+/** @brief  Map an image file into memory and open it
+  * @param  img         (bintex_img*) receives the image
+  * @param  path        (const char*) path of image file
+  * @retval (int)       0 on success, or BINTEX_ERROR
+  * @ingroup BinTex
+  * @sa bintex_img_close()
+  *
+  * Available on POSIX systems.
+  */
+int bintex_img_load(bintex_img* img, const char* path);
+
+
+
+/** @brief  Unmap an image loaded by bintex_img_load()
+  * @param  img         (bintex_img*) image
+  * @retval None
+  * @ingroup BinTex
+  */
+void bintex_img_close(bintex_img* img);
+
+
+
+/** @brief  Get a template from an image
+  * @param  img         (const bintex_img*) image
+  * @param  index       (size_t) index of the template
+  * @param  tpl         (bintex_tpl*) receives the template
+  * @retval (int)       0 on success, or BINTEX_ERROR if index is out of range
+  * @ingroup BinTex
+  *
+  * The template points into the image.  It can be rendered as long as the 
+  * image is open, and must not be passed to bintex_tpl_free().
+  */
+int bintex_img_get(const bintex_img* img, size_t index, bintex_tpl* tpl);
+
+
+
+/** @brief  Look up a template in an image by name
+  * @param  img         (const bintex_img*) image
+  * @param  name        (const char*) template name
+  * @retval (int)       index of the template, or BINTEX_ERROR if there is none
+  * @ingroup BinTex
+  */
+int bintex_img_find(const bintex_img* img, const char* name);
+
+
+
+/** @brief  Output Bintex with values from arguments, like printf()
+  * @param  out         (uint8_t*) byte-wise, binary output
+  * @param  out_len     (size_t) allocation limit of out
+  * @param  fmt         (const char*) Bintex with conversions in it
+  * @param  ...         arguments of the conversions, in order
+  * @retval (ssize_t)   number of bytes output, BINTEX_FULL if the output 
+  *                     doesn't fit, or BINTEX_ERROR if fmt is invalid
+  * @ingroup BinTex
+  * @sa bintex_tpl_compile()
+  *
+  * Arguments are written in their binary form, as a template slot is, with
+  * no conversion to text.  The conversions depend on where they are written:
+  *
+  * outside blocks  %c %s %l, %uc %us %ul: 1, 2 or 4 byte number, from an int
+  *                 %x: 1 byte, from an int
+  *                 %Nx: N bytes, from a const void*  (e.g. %16x)
+  *                 %*x: an int length, then a const void*
+  * in [ ]          %x, %Nx, %*x
+  * in ( )          %c %s %l, %uc %us %ul
+  * in " "          %s: a NUL-terminated string, %*s: an int length, then a
+  *                 const char*, %%: a '%' character
+  *
+  * For example: bintex_format(out, len, "[0A %x] (%us %ul) \"%s\"", 7, seq, 
+  *              id, name);
+  *
+  * Each thread keeps the last formats it used in compiled form, so a format
+  * is parsed only the first time it is used.  Up to 32 conversions are allowed.
+  */
+ssize_t bintex_format(uint8_t* out, size_t out_len, const char* fmt, ...);
+
+
+
+/** @brief  bintex_format() with a va_list
+  * @ingroup BinTex
+  */
+ssize_t bintex_vformat(uint8_t* out, size_t out_len, const char* fmt, va_list ap);
+
+
+
+/** @brief  Free the formats compiled by the calling thread
+  * @retval None
+  * @ingroup BinTex
+  *
+  * Call this before a thread that has used bintex_format() exits, or to 
+  * release the memory of formats that are no longer used.
+  */
+void bintex_format_flush(void);
+
+
+
+/** @brief  Copy the parser counters of the calling thread
+  * @param  stats       (bintex_stats*) output counters
+  * @retval (int)       0, or BINTEX_ERROR if the library was built without
+  *                     __BINTEX_STATS__, in which case stats is zeroed
+  * @ingroup BinTex
+  *
+  * The counters of a thread are those of every parse it ran with a context
+  * that has no stats of its own, which includes all of the functions that
+  * are not "_r".  Worker threads of bintex_par_sn() and bintex_batch() count
+  * into their own counters, which are not collected.
+  */
+int bintex_stats_get(bintex_stats* stats);
+
+
+
+/** @brief  Zero the parser counters of the calling thread
+  * @retval None
+  * @ingroup BinTex
+  */
+void bintex_stats_reset(void);
+
+
+
+/** @brief  Reentrant variants of the parser functions
+  * @param  ctx         (bintex_ctx*) parser context, initialized by bintex_ctx_init()
+  * @ingroup BinTex
+  * @sa bintex_fs(), bintex_ss(), bintex_iter_fq(), bintex_iter_sq(), 
+  *     bintex_sn(), bintex_snq(), bintex_iter_snq(), bintex_measure()
+  *
+  * Other parameters and return values are identical to the non-reentrant
+  * functions.  After each call, ctx->error holds the return code that ended
+  * the parsing (e.g. BINTEX_EOF), and for string input ctx->cursor points to
+  * the next unread character.
+  *
+  * File input to the "_r" variants is read in blocks of BINTEX_BLOCKSIZE bytes
+  * into a buffer held by the context.  bintex_fs_r() seeks a file back to just
+  * past the input it parsed, so ';'-separated messages can be read from one
+  * FILE by repeated calls.  
+  *
+  * A stream that can't seek (a pipe, socket or tty) is read from its file
+  * descriptor, as by bintex_fd(), with each read taking what has arrived, so
+  * an expression is parsed as soon as its bytes are read.  Data already held
+  * in the FILE's own buffer by earlier stdio calls is not seen.  Input read
+  * past the end of parsing stays in the context, and the next call with the
+  * same context and file parses it first.
+  *
+  * bintex_iter_fq_r() keeps the block while it is called with the same file,
+  * so data is read from the file ahead of the parser and the file position is
+  * past it.  Use bintex_ctx_free() when done.
+  */
+ssize_t bintex_fs_r(bintex_ctx* ctx, FILE* file, unsigned char* stream_out, size_t size);
+ssize_t bintex_ss_r(bintex_ctx* ctx, unsigned char* string, unsigned char* stream_out, size_t size);
+ssize_t bintex_iter_fq_r(bintex_ctx* ctx, FILE* file, bintex_q* msg);
+ssize_t bintex_iter_sq_r(bintex_ctx* ctx, unsigned char** string, bintex_q* msg, size_t size);
+ssize_t bintex_sn_r(bintex_ctx* ctx, const uint8_t* in, size_t in_len, uint8_t* out, size_t out_len);
+ssize_t bintex_snq_r(bintex_ctx* ctx, const uint8_t* in, size_t in_len, bintex_q* msg);
+ssize_t bintex_iter_snq_r(bintex_ctx* ctx, const uint8_t** in, size_t* in_len, bintex_q* msg);
+ssize_t bintex_measure_r(bintex_ctx* ctx, const uint8_t* in, size_t in_len, size_t* sizes, size_t* count);
 
 
 
@@ -209,11 +993,11 @@ int main(int argc, char** argv);
 /** @brief Generic initialization routine for Queues.
   * @param q        (bintex_q*) Pointer to the Queue ADT
   * @param buffer   (uint8_t*) Queue data buffer
-  * @param alloc    (uint16_t) allocated bytes for queue
+  * @param alloc    (size_t) allocated bytes for queue
   * @retval none
   * @ingroup Queue
   */
-void q_init(bintex_q* q, uint8_t* buffer, uint16_t alloc);
+void q_init(bintex_q* q, uint8_t* buffer, size_t alloc);
 
 
 /** @brief Reposition the Queue pointers to a new buffer, don't change attributes
@@ -243,9 +1027,9 @@ void q_copy(bintex_q* q1, bintex_q* q2);
   * @retval none
   * @ingroup Queue
   */
-int16_t q_length(bintex_q* q);
-int16_t q_span(bintex_q* q);
-int16_t q_space(bintex_q* q);
+size_t q_length(bintex_q* q);
+size_t q_span(bintex_q* q);
+size_t q_space(bintex_q* q);
 
 
 
@@ -259,12 +1043,12 @@ void q_empty(bintex_q* q);
 
 /** @brief Starts a queue by loading in config data
   * @param q        (bintex_q*) Pointer to the Queue ADT
-  * @param offset   (int) bytes to offset the fist data writes from the front
+  * @param offset   (size_t) bytes to offset the fist data writes from the front
   * @param options  (uint16_t) option bits.  user-defined usage.
   * @retval uint8_t*  Pointer to queue get & putcursor, or NULL if an error
   * @ingroup Queue
   */
-uint8_t* q_start(bintex_q* q, int offset, uint16_t options);
+uint8_t* q_start(bintex_q* q, size_t offset, uint16_t options);
 
 
 
@@ -348,8 +1132,8 @@ uint16_t q_readshort_be(bintex_q* q);
 uint32_t q_readlong(bintex_q* q);
 
 
-void q_writestring(bintex_q* q, uint8_t* string, int length);
-void q_readstring(bintex_q* q, uint8_t* string, int length);
+void q_writestring(bintex_q* q, uint8_t* string, size_t length);
+void q_readstring(bintex_q* q, uint8_t* string, size_t length);
 
 
 #endif
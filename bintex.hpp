@@ -0,0 +1,629 @@
+/*  Copyright 2010-2018, JP Norair
+  *
+  * Licensed under the OpenTag License, Version 1.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  * http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  */
+
+/**
+  * @file       bintex.hpp
+  * @author     JP Norair
+  * @version    V1.1
+  * @date       27 Jun 2018
+  * @brief      Compile-time BinTex literals for C++
+  * @ingroup    BinTex
+  *
+  * Constant BinTex strings are parsed by the compiler into a std::array, so
+  * they cost nothing at runtime.  The rules are those of bintex_sn(): the
+  * same tokens, limits, odd-nibble rule for hex and type-code rules for
+  * decimal numbers, and parsing ends at a ';'.
+  *
+  * C++20:
+  *     constexpr auto& a = bintex::literal<"[0A 01] d300 \"hi\"">;
+  *     using namespace bintex::literals;
+  *     constexpr auto  b = "[0A 01] d300 \"hi\""_btx;
+  *
+  * C++17:
+  *     constexpr auto  c = BINTEX_LITERAL("[0A 01] d300 \"hi\"");
+  *
+  * bintex::encoder (C++20) compiles a bintex_format() style format with fixed
+  * size conversions into a frame and a list of fields.
+  *
+  * Input that bintex_sn() would stop on with BINTEX_ERROR does not compile.
+  * Neither does input that it would accept only by skipping part of it: a
+  * single token must end in whitespace or at the end of the string, a type
+  * code must be the last thing in a number, and a number must fit in 32 bits
+  * signed, which is what the C parser computes it in.
+  ******************************************************************************
+  */
+
+#ifndef __BINTEX_HPP
+#define __BINTEX_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#if __cplusplus >= 202002L
+#   include <iterator>
+#   include <span>
+#endif
+
+
+namespace bintex {
+
+/// Thrown while parsing a literal.  At compile time, this is a compile error.
+struct error {
+    const char* what;
+};
+
+
+namespace detail {
+
+struct sink {
+    std::uint8_t*   out;
+    std::size_t     n;
+
+    constexpr void put(std::uint8_t byte) {
+        if (out != nullptr) {
+            out[n] = byte;
+        }
+        n++;
+    }
+};
+
+/// Same as sub_bufferngetc(): -1 at the end of input or at a NUL
+struct source {
+    std::string_view s;
+    std::size_t     i;
+
+    constexpr int getc() {
+        if ((i >= s.size()) || (s[i] == 0)) {
+            return -1;
+        }
+        return (unsigned char)s[i++];
+    }
+};
+
+constexpr bool is_whitespace(int c) { return (c==' ') || (c=='\r') || (c=='\n') || (c=='\t'); }
+constexpr bool is_hexval(int c)     { return ((c>='0') && (c<='9')) || ((c>='a') && (c<='f')) || ((c>='A') && (c<='F')); }
+constexpr bool is_decval(int c)     { return (c>='0') && (c<='9'); }
+constexpr bool is_binval(int c)     { return (c=='0') || (c=='1'); }
+constexpr bool is_dectoken(int c)   { return is_decval(c) || (c=='-') || (c=='u') || (c=='c') || (c=='s') || (c=='l'); }
+
+constexpr std::uint8_t char2hex(int c) {
+    return (std::uint8_t)((c <= '9') ? (c - '0') : ((c | 0x20) - 'a' + 10));
+}
+
+/// Status, as in the C digit collectors: 0 for whitespace or a full token,
+/// 1 for the block end character, 2 for anything else, including the end
+template <typename Pred>
+constexpr int digits(source& in, char* buf, int limit, int end, int& status, Pred valid) {
+    int n   = 0;
+    status  = 0;
+
+    while (n < limit) {
+        int c = in.getc();
+        if ((end != 0) && (c == end)) {
+            status = 1;
+            break;
+        }
+        if (!valid(c)) {
+            if (!is_whitespace(c)) {
+                status = (c < 0) ? 3 : 2;
+            }
+            break;
+        }
+        buf[n++] = (char)c;
+    }
+    return n;
+}
+
+constexpr void puthex(sink& out, const char* buf, int n) {
+    int i = 0;
+
+    if (n & 1) {
+        out.put(char2hex(buf[i++]));
+    }
+    for (; i<n; i+=2) {
+        out.put((std::uint8_t)((char2hex(buf[i]) << 4) | char2hex(buf[i+1])));
+    }
+}
+
+constexpr void putbin(sink& out, const char* buf, int n) {
+    std::uint8_t byte   = 0;
+    int          i      = 0;
+    int          shift  = n & 7;
+
+    // A length that is not a multiple of 8 pads the first byte
+    if (shift == 0) {
+        shift = 8;
+    }
+    while (i < n) {
+        byte |= (std::uint8_t)((buf[i++] & 1) << --shift);
+        if (shift == 0) {
+            out.put(byte);
+            byte    = 0;
+            shift   = 8;
+        }
+    }
+}
+
+/// Same as sub_putdec(), with errors thrown instead of ignored
+constexpr void putdec(sink& out, const char* buf, int n) {
+    long long   number  = 0;
+    int         sign    = 1;
+    int         force_u = 0;
+    int         size    = 0;
+    int         i       = 0;
+
+    if (n == 0) {
+        return;
+    }
+    if (buf[i] == '-') {
+        i++;
+        sign = -1;
+    }
+    if ((i >= n) || !is_decval(buf[i])) {
+        throw error{"bintex: number has no digits"};
+    }
+    while ((i < n) && is_decval(buf[i])) {
+        number = (number * 10) + (buf[i++] - '0');
+        if (number > 2147483647LL) {
+            throw error{"bintex: number does not fit in 32 bits"};
+        }
+    }
+    if (i < n) {
+        force_u = (buf[i] == 'u');
+        i      += force_u;
+        if (i < n) {
+            if (buf[i] == 'c')      size = 1;
+            else if (buf[i] == 's') size = 2;
+            else if (buf[i] == 'l') size = 3;
+            i += (size != 0);
+        }
+    }
+    if (i != n) {
+        throw error{"bintex: invalid type code"};
+    }
+
+    // Smallest container, when there is no type code
+    if (size == 0) {
+        const long long bound[] = {128, 256, 32768, 65536, 0, 0};
+        long long       max     = number - (sign < 0);
+        int             j = 0;
+
+        for (j=force_u, size=1; (bound[j] != 0) && (bound[j] < max); j+=2, size++);
+    }
+
+    number *= sign;
+    switch (size & 3) {
+        case 2: out.put((std::uint8_t)(number >> 8));
+                out.put((std::uint8_t)number);
+                break;
+
+        case 3: out.put((std::uint8_t)(number >> 24));
+                out.put((std::uint8_t)(number >> 16));
+                out.put((std::uint8_t)(number >> 8));
+                out.put((std::uint8_t)number);
+                break;
+
+        default:out.put((std::uint8_t)number);
+                break;
+    }
+}
+
+constexpr int escape(int c) {
+    switch (c) {
+        case 'a':   return '\a';
+        case '\\':  return '\\';
+        case 'b':   return '\b';
+        case 'r':   return '\r';
+        case '"':   return '\"';
+        case 'f':   return '\f';
+        case 't':   return '\t';
+        case 'n':   return '\n';
+        case '0':   return '\0';
+        case '\'':  return '\'';
+        case 'v':   return '\v';
+        case '?':   return '\?';
+    }
+    return '\\';
+}
+
+/// Argument of an encoder, at offset in its frame
+enum : int {
+    FIELD_num = 0,
+    FIELD_bytes
+};
+
+struct field {
+    std::size_t     offset;
+    std::size_t     size;
+    int             kind;
+};
+
+/// Reads a slot after its '%', as in sub_tplslot(): c, s or l for a number, or
+/// x and a byte count
+constexpr void slot(source& in, sink& o, field* fields, std::size_t& count) {
+    field   f   {o.n, 0, FIELD_num};
+    int     c   = in.getc();
+
+    switch (c) {
+        case 'c':   f.size = 1;  break;
+        case 's':   f.size = 2;  break;
+        case 'l':   f.size = 4;  break;
+        case 'x':   f.kind = FIELD_bytes;
+                    while (is_decval(c = in.getc())) {
+                        f.size = (f.size * 10) + (c - '0');
+                    }
+                    if ((f.size == 0) || !is_whitespace(c)) {
+                        throw error{"bintex: invalid slot"};
+                    }
+                    break;
+        default:    throw error{"bintex: invalid slot"};
+    }
+
+    for (std::size_t i=0; i<f.size; i++) {
+        o.put(0);
+    }
+    if (fields != nullptr) {
+        fields[count] = f;
+    }
+    count++;
+}
+
+/// Parses s into out, or only measures it if out is nullptr.  If count is not
+/// nullptr, '%' starts a slot, which is counted and put in fields.
+constexpr std::size_t parse(std::string_view s, std::uint8_t* out, field* fields = nullptr, std::size_t* count = nullptr) {
+    source  in  {s, 0};
+    sink    o   {out, 0};
+    char    buf[72] {};
+    int     status = 0;
+    int     n = 0;
+    int     c = 0;
+
+    while (true) {
+        switch (c = in.getc()) {
+            case '\n':
+            case '\r':
+            case '\t':
+            case '0':
+            case ' ':   break;
+
+            case ';':
+            case -1:    return o.n;
+
+            case '#':   do {
+                            c = in.getc();
+                        } while ((c >= 0) && (c != '\n'));
+                        break;
+
+            case '"':   while ((c = in.getc()) != '"') {
+                            if (c < 0) {
+                                throw error{"bintex: unterminated string"};
+                            }
+                            if (c == '\\') {
+                                c = escape(in.getc());
+                            }
+                            o.put((std::uint8_t)c);
+                        }
+                        break;
+
+            case 'b':   n = digits(in, buf, 32, 0, status, is_binval);
+                        if ((status == 1) || (status == 2)) {
+                            throw error{"bintex: invalid binary token"};
+                        }
+                        putbin(o, buf, n);
+                        break;
+
+            case 'x':   n = digits(in, buf, 64, 0, status, is_hexval);
+                        if ((status == 1) || (status == 2)) {
+                            throw error{"bintex: invalid hex token"};
+                        }
+                        puthex(o, buf, n);
+                        break;
+
+            case 'd':   n = digits(in, buf, 15, 0, status, is_dectoken);
+                        if ((status == 1) || (status == 2)) {
+                            throw error{"bintex: invalid decimal token"};
+                        }
+                        putdec(o, buf, n);
+                        break;
+
+            case '[':   do {
+                            n = digits(in, buf, 64, ']', status, is_hexval);
+                            if (status > 1) {
+                                throw error{"bintex: invalid or unterminated hex block"};
+                            }
+                            puthex(o, buf, n);
+                        } while (status == 0);
+                        break;
+
+            case '(':   do {
+                            n = digits(in, buf, 15, ')', status, is_dectoken);
+                            if (status > 1) {
+                                throw error{"bintex: invalid or unterminated decimal block"};
+                            }
+                            putdec(o, buf, n);
+                        } while (status == 0);
+                        break;
+
+            case '%':   if (count == nullptr) {
+                            throw error{"bintex: invalid character"};
+                        }
+                        slot(in, o, fields, *count);
+                        break;
+
+            default:    throw error{"bintex: invalid character"};
+        }
+    }
+}
+
+template <std::size_t N>
+constexpr std::array<std::uint8_t, N> fill(std::string_view s) {
+    std::array<std::uint8_t, N> a {};
+    parse(s, a.data());
+    return a;
+}
+
+template <typename F>
+constexpr auto from_lambda(F f) {
+    constexpr std::string_view  s = f();
+    constexpr std::size_t       n = parse(s, nullptr);
+    constexpr auto              a = fill<n>(s);
+    return a;
+}
+
+} // namespace detail
+
+
+
+#if __cplusplus >= 202002L
+/// String literal as a template argument
+template <std::size_t N>
+struct fixed_string {
+    char data[N] {};
+
+    constexpr fixed_string(const char (&s)[N]) {
+        for (std::size_t i=0; i<N; i++) {
+            data[i] = s[i];
+        }
+    }
+    constexpr std::string_view view() const { return std::string_view(data, N-1); }
+};
+
+/// Output of a BinTex string, as std::array<uint8_t, N>
+template <fixed_string S>
+inline constexpr auto literal = detail::fill<detail::parse(S.view(), nullptr)>(S.view());
+
+namespace literals {
+    template <fixed_string S>
+    constexpr const auto& operator""_btx() {
+        return literal<S>;
+    }
+}
+
+
+namespace detail {
+
+template <std::size_t N>
+struct fmt_text {
+    char            data[N] {};
+    std::size_t     len = 0;
+
+    constexpr void put(char c)          { data[len++] = c; }
+    constexpr void put(const char* s)   { while (*s != 0) put(*s++); }
+    constexpr std::string_view view() const { return std::string_view(data, len); }
+};
+
+/// Same as sub_fmtconv(), except that only fixed size conversions are allowed
+template <std::size_t N>
+constexpr std::size_t conv(fmt_text<N>& t, std::string_view fmt, std::size_t i, int context) {
+    auto        at  = [&](std::size_t j) { return (j < fmt.size()) ? fmt[j] : '\0'; };
+    std::size_t p   = i + 1;
+    std::size_t n   = 0;
+    char        k;
+
+    if ((at(p) == '*') || (context == '"')) {
+        throw error{"bintex: an encoder has no variable size conversions"};
+    }
+    while (is_decval(at(p)) && (n <= 65535)) {
+        n = (n * 10) + (at(p++) - '0');
+    }
+    k = at(p);
+
+    if (context == '[')         t.put(']');
+    else if (context == '(')    t.put(')');
+    t.put(' ');
+    t.put('%');
+
+    if (k == 'x') {
+        if ((context == '(') || (n > 65535)) {
+            throw error{"bintex: invalid conversion"};
+        }
+        if (n == 0) {
+            t.put('c');
+        }
+        else {
+            char dec[8] {};
+            int  d = 0;
+            for (; n != 0; n /= 10) dec[d++] = (char)('0' + (n % 10));
+            t.put('x');
+            while (d > 0) t.put(dec[--d]);
+        }
+    }
+    else {
+        if ((context == '[') || (n != 0)) {
+            throw error{"bintex: invalid conversion"};
+        }
+        if (k == 'u') {
+            k = at(++p);
+        }
+        if ((k != 'c') && (k != 's') && (k != 'l')) {
+            throw error{"bintex: invalid conversion"};
+        }
+        t.put(k);
+    }
+
+    t.put(' ');
+    if (context == '[')         t.put('[');
+    else if (context == '(')    t.put('(');
+    return p + 1;
+}
+
+/// Same as sub_fmtcompile(): conversions are moved out of their blocks
+template <std::size_t N>
+constexpr fmt_text<(3*N)+1> rewrite(std::string_view fmt) {
+    fmt_text<(3*N)+1> t {};
+    std::size_t     i       = 0;
+    int             context = 0;
+
+    while ((i < fmt.size()) && (fmt[i] != 0)) {
+        char c = fmt[i];
+
+        if ((c == '%') && (context != '#') && !((context == '"') && ((i+1) < fmt.size()) && (fmt[i+1] == '%'))) {
+            i = conv(t, fmt, i, context);
+            continue;
+        }
+
+        t.put(c);
+        i++;
+        switch (context) {
+            case 0:     if ((c == '"') || (c == '[') || (c == '(') || (c == '#')) context = c;
+                        break;
+            case '"':   if ((c == '\\') && (i < fmt.size()))   t.put(fmt[i++]);
+                        else if (c == '%')                      i++;
+                        else if (c == '"')                      context = 0;
+                        break;
+            case '[':   if (c == ']') context = 0;
+                        break;
+            case '(':   if (c == ')') context = 0;
+                        break;
+            case '#':   if (c == '\n') context = 0;
+                        break;
+        }
+    }
+    return t;
+}
+
+template <std::size_t Size, std::size_t Count>
+struct fmt_frame {
+    std::array<std::uint8_t, Size>  bytes {};
+    std::array<field, Count>        fields {};
+};
+
+constexpr std::size_t count_fields(std::string_view s) {
+    std::size_t n = 0;
+    parse(s, nullptr, nullptr, &n);
+    return n;
+}
+
+constexpr std::size_t frame_size(std::string_view s) {
+    std::size_t n = 0;
+    return parse(s, nullptr, nullptr, &n);
+}
+
+template <std::size_t Size, std::size_t Count>
+constexpr fmt_frame<Size, Count> build(std::string_view s) {
+    fmt_frame<Size, Count> f {};
+    std::size_t         n = 0;
+    parse(s, f.bytes.data(), f.fields.data(), &n);
+    return f;
+}
+
+template <fixed_string F>
+struct layout {
+    static constexpr auto           text    = rewrite<sizeof(F.data)>(F.view());
+    static constexpr std::size_t    size    = frame_size(text.view());
+    static constexpr std::size_t    count   = count_fields(text.view());
+    static constexpr auto           frame   = build<size, count>(text.view());
+};
+
+} // namespace detail
+
+
+/** Encoder for a fixed layout, with the conversions of bintex_format() that
+  * have a fixed size: %c %s %l %uc %us %ul for numbers, %x for a byte and %Nx
+  * for N bytes.  The format is parsed by the compiler, so encode() copies a
+  * frame of known size and stores each argument at a known offset.
+  *
+  *     using hello = bintex::encoder<"[A0 01] (%us) (%ul) [%4x]">;
+  *     std::array<uint8_t, hello::size> buf;
+  *     hello::encode(buf, seq, id, key);
+  *
+  * Numbers are integers, stored big-endian like dec tokens.  Bytes are a
+  * pointer or anything with data(), from which N bytes are copied.
+  */
+template <fixed_string F>
+struct encoder {
+    using layout = detail::layout<F>;
+
+    static constexpr std::size_t size   = layout::size;
+    static constexpr std::size_t args   = layout::count;
+
+    template <typename... A>
+    static void encode(std::span<std::uint8_t, size> out, const A&... a) {
+        encode(out.data(), a...);
+    }
+
+    /// out must have room for size bytes
+    template <typename... A>
+    static void encode(std::uint8_t* out, const A&... a) {
+        static_assert(sizeof...(A) == args, "bintex::encoder: wrong number of arguments");
+        if constexpr (size != 0) {
+            std::memcpy(out, layout::frame.bytes.data(), size);
+        }
+        put_all(out, std::index_sequence_for<A...>{}, a...);
+    }
+
+private:
+    template <std::size_t... I, typename... A>
+    static void put_all(std::uint8_t* out, std::index_sequence<I...>, const A&... a) {
+        (void)out;
+        (put<I>(out, a), ...);
+    }
+
+    template <std::size_t I, typename A>
+    static void put(std::uint8_t* out, const A& a) {
+        constexpr detail::field f = layout::frame.fields[I];
+
+        if constexpr (f.kind == detail::FIELD_num) {
+            static_assert(std::is_integral_v<A> || std::is_enum_v<A>, "bintex::encoder: number argument expected");
+            std::uint32_t   v = static_cast<std::uint32_t>(a);
+            std::uint8_t    be[f.size] {};
+
+            // Collected first, so the compiler can store it as one word
+            for (std::size_t i=0; i<f.size; i++) {
+                be[i] = static_cast<std::uint8_t>(v >> (8 * (f.size - 1 - i)));
+            }
+            std::memcpy(out + f.offset, be, f.size);
+        }
+        else if constexpr (std::is_pointer_v<A>) {
+            std::memcpy(out + f.offset, a, f.size);
+        }
+        else {
+            std::memcpy(out + f.offset, std::data(a), f.size);
+        }
+    }
+};
+#endif
+
+} // namespace bintex
+
+
+/// C++17 form of bintex::literal, for a string literal argument
+#define BINTEX_LITERAL(STR) (::bintex::detail::from_lambda([]() constexpr { return std::string_view(STR); }))
+
+#endif
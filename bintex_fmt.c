@@ -0,0 +1,288 @@
+/*  Copyright 2010-2018, JP Norair
+  *
+  * Licensed under the OpenTag License, Version 1.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  * http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  */
+
+/**
+  * @file       bintex_fmt.c
+  * @author     JP Norair
+  * @version    V1.1
+  * @date       27 Jun 2018
+  * @brief      printf-style BinTex formatting
+  * @ingroup    BinTex
+  *
+  * A format is rewritten into a template (see bintex_tpl_compile()), with its
+  * conversions moved out of the blocks and strings they are written in, so
+  * "[0A %x] (%us)" becomes "[0A ] %c [] () %s ()".  The compiled template is kept
+  * in a small cache for each thread, so a format is parsed once and each call
+  * only collects its arguments and renders the template.
+  ******************************************************************************
+  */
+
+#include "bintex.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Number of formats cached by each thread, a power of 2
+#ifndef BINTEX_FMT_CACHE
+#   define BINTEX_FMT_CACHE     32
+#endif
+
+// Most conversions in one format
+#ifndef BINTEX_FMT_SLOTS
+#   define BINTEX_FMT_SLOTS     32
+#endif
+
+/// How the argument of each slot is taken from the argument list
+typedef enum {
+    ARG_num = 0,
+    ARG_bytes,
+    ARG_cstring,
+    ARG_counted
+} Arg_type;
+
+typedef struct {
+    const char*     fmt;
+    char*           text;
+    size_t          len;
+    bintex_tpl      tpl;
+    uint8_t         arg[BINTEX_FMT_SLOTS];
+} fmt_entry;
+
+static __thread fmt_entry fmt_cache[BINTEX_FMT_CACHE];
+
+
+static fmt_entry* sub_fmtlookup(const char* fmt);
+static int sub_fmtcompile(fmt_entry* entry, const char* fmt, size_t len);
+static int sub_fmtconv(char** out, const char** in, int context, uint8_t* arg);
+
+
+
+
+ssize_t bintex_format(uint8_t* out, size_t out_len, const char* fmt, ...) {
+    va_list ap;
+    ssize_t rc;
+
+    va_start(ap, fmt);
+    rc = bintex_vformat(out, out_len, fmt, ap);
+    va_end(ap);
+    return rc;
+}
+
+
+ssize_t bintex_vformat(uint8_t* out, size_t out_len, const char* fmt, va_list ap) {
+    bintex_val  vals[BINTEX_FMT_SLOTS];
+    fmt_entry*  entry;
+    size_t      i;
+
+    entry = sub_fmtlookup(fmt);
+    if (entry == NULL) {
+        return BINTEX_ERROR;
+    }
+
+    for (i=0; i<entry->tpl.slots; i++) {
+        switch (entry->arg[i]) {
+            case ARG_num:       vals[i].num     = va_arg(ap, unsigned int);
+                                break;
+
+            case ARG_bytes:     vals[i].data    = va_arg(ap, const void*);
+                                break;
+
+            case ARG_cstring:   vals[i].data    = va_arg(ap, const char*);
+                                vals[i].len     = strlen(vals[i].data);
+                                break;
+
+            default:            vals[i].len     = (size_t)va_arg(ap, int);
+                                vals[i].data    = va_arg(ap, const void*);
+                                break;
+        }
+    }
+
+    return bintex_tpl_render(&entry->tpl, vals, out, out_len);
+}
+
+
+void bintex_format_flush(void) {
+    int i;
+
+    for (i=0; i<BINTEX_FMT_CACHE; i++) {
+        if (fmt_cache[i].fmt != NULL) {
+            bintex_tpl_free(&fmt_cache[i].tpl);
+            free(fmt_cache[i].text);
+        }
+        memset(&fmt_cache[i], 0, sizeof(fmt_entry));
+    }
+}
+
+
+
+
+/// Finds the compiled format in the cache, or compiles it into the entry for
+/// its address.  The text is compared too, because the format may be in a
+/// buffer that is reused for another format.
+static fmt_entry* sub_fmtlookup(const char* fmt) {
+    fmt_entry*  entry;
+    size_t      len;
+
+    entry   = &fmt_cache[((uintptr_t)fmt >> 3) & (BINTEX_FMT_CACHE-1)];
+    len     = strlen(fmt);
+
+    if ((entry->fmt == fmt) && (entry->len == len) && (memcmp(entry->text, fmt, len) == 0)) {
+        return entry;
+    }
+    if (entry->fmt != NULL) {
+        bintex_tpl_free(&entry->tpl);
+        free(entry->text);
+        memset(entry, 0, sizeof(fmt_entry));
+    }
+    if (sub_fmtcompile(entry, fmt, len) != 0) {
+        return NULL;
+    }
+    return entry;
+}
+
+
+static int sub_fmtcompile(fmt_entry* entry, const char* fmt, size_t len) {
+    const char* in      = fmt;
+    char*       text;
+    char*       out;
+    int         context = 0;
+    size_t      slots   = 0;
+
+    // A conversion is rewritten to at most 3 times its length
+    text = malloc((len * 3) + 1);
+    if (text == NULL) {
+        return -1;
+    }
+
+    out = text;
+    while (*in != 0) {
+        char c = *in;
+
+        if ((c == '%') && (context != '#') && !((context == '"') && (in[1] == '%'))) {
+            if ((slots == BINTEX_FMT_SLOTS) || (sub_fmtconv(&out, &in, context, &entry->arg[slots]) != 0)) {
+                goto sub_fmtcompile_error;
+            }
+            slots++;
+            continue;
+        }
+
+        *out++ = *in++;
+        switch (context) {
+            case 0:     if ((c == '"') || (c == '[') || (c == '(') || (c == '#')) context = c;
+                        break;
+            case '"':   if ((c == '\\') && (*in != 0))  *out++ = *in++;
+                        else if (c == '%')              in++;
+                        else if (c == '"')              context = 0;
+                        break;
+            case '[':   if (c == ']') context = 0;
+                        break;
+            case '(':   if (c == ')') context = 0;
+                        break;
+            case '#':   if (c == '\n') context = 0;
+                        break;
+        }
+    }
+
+    if (bintex_tpl_compile(&entry->tpl, (const uint8_t*)text, out - text) != 0) {
+        goto sub_fmtcompile_error;
+    }
+
+    // The template text is kept to compare with later calls
+    memcpy(text, fmt, len);
+    entry->fmt  = fmt;
+    entry->text = text;
+    entry->len  = len;
+    return 0;
+
+    sub_fmtcompile_error:
+    free(text);
+    return -1;
+}
+
+
+/// Rewrites one conversion, at *in, as a template slot, closing and reopening
+/// the block or string it is in.  The conversions of each context are:
+///
+/// top level       %c %s %l (optionally after u), %x, %Nx, %*x
+/// [ ]             %x (one byte), %Nx (N bytes), %*x (int length and bytes)
+/// ( )             %c %s %l, optionally after u
+/// " "             %s (NUL-terminated), %*s (int length and bytes), %%
+static int sub_fmtconv(char** out, const char** in, int context, uint8_t* arg) {
+    const char* p = *in + 1;
+    char*       o = *out;
+    char        slot[16];
+    size_t      n = 0;
+
+    if (*p == '*') {
+        p++;
+        n = (size_t)-1;
+    }
+    else {
+        while ((*p >= '0') && (*p <= '9') && (n <= 65535)) {
+            n = (n * 10) + (*p++ - '0');
+        }
+    }
+
+    if (context == '"') {
+        if (*p != 's') {
+            return -1;
+        }
+        *arg = (n == (size_t)-1) ? ARG_counted : ARG_cstring;
+        strcpy(slot, "\"%a\"");
+    }
+    else if (*p == 'x') {
+        if (context == '(') {
+            return -1;
+        }
+        if (n == (size_t)-1) {
+            *arg = ARG_counted;
+            strcpy(slot, " %a ");
+        }
+        else if (n == 0) {
+            *arg = ARG_num;
+            strcpy(slot, " %c ");
+        }
+        else if (n <= 65535) {
+            *arg = ARG_bytes;
+            sprintf(slot, " %%x%u ", (unsigned)n);
+        }
+        else {
+            return -1;
+        }
+    }
+    else {
+        if ((context == '[') || (n != 0)) {
+            return -1;
+        }
+        if (*p == 'u') {
+            p++;
+        }
+        if ((*p != 'c') && (*p != 's') && (*p != 'l')) {
+            return -1;
+        }
+        *arg = ARG_num;
+        sprintf(slot, " %%%c ", *p);
+    }
+
+    // The block or string is closed before the slot and opened again after it
+    if (context == '[')         *o++ = ']';
+    else if (context == '(')    *o++ = ')';
+    o = stpcpy(o, slot);
+    if (context == '[')         *o++ = '[';
+    else if (context == '(')    *o++ = '(';
+
+    *out    = o;
+    *in     = p + 1;
+    return 0;
+}
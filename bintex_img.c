@@ -0,0 +1,276 @@
+/*  Copyright 2010-2018, JP Norair
+  *
+  * Licensed under the OpenTag License, Version 1.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  * http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  */
+
+/**
+  * @file       bintex_img.c
+  * @author     JP Norair
+  * @version    V1.1
+  * @date       27 Jun 2018
+  * @brief      Serialized images of compiled BinTex templates
+  * @ingroup    BinTex
+  *
+  * An image holds many compiled templates in one block of memory, laid out
+  * so that it can be used in place once mapped from a file:
+  *
+  * header          magic "BTXI", version, byte order mark, template count
+  *                 and image size
+  * entries         one per template: name, and the offsets and lengths of
+  *                 its slot table and frame
+  * data            each template's slot table (8 byte aligned), then frame
+  *
+  * All offsets are from the start of the image.  Numbers are in the byte
+  * order of the machine that wrote the image, which is checked on open.
+  ******************************************************************************
+  */
+
+#include "bintex.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#   include <fcntl.h>
+#   include <unistd.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#endif
+
+#define IMG_MAGIC       "BTXI"
+#define IMG_ORDER       0x0102
+#define IMG_ALIGN(N)    (((N) + 7) & ~(uint64_t)7)
+
+typedef struct {
+    char            magic[4];
+    uint16_t        version;
+    uint16_t        order;
+    uint32_t        count;
+    uint32_t        rfu;
+    uint64_t        size;
+} img_header;
+
+typedef struct {
+    char            name[BINTEX_IMGNAME];
+    uint64_t        slot;
+    uint64_t        slots;
+    uint64_t        frame;
+    uint64_t        frame_len;
+} img_entry;
+
+
+static int sub_checkentry(const uint8_t* base, const img_entry* entry, uint64_t size);
+
+
+
+
+ssize_t bintex_img_write(const bintex_tpl* tpls, const char* const* names, size_t count, uint8_t* out, size_t out_len) {
+    img_header* header;
+    img_entry*  entry;
+    uint64_t    total;
+    size_t      i;
+
+    total = sizeof(img_header) + (count * sizeof(img_entry));
+    for (i=0; i<count; i++) {
+        total  = IMG_ALIGN(total) + (tpls[i].slots * sizeof(bintex_slot));
+        total += tpls[i].frame_len;
+    }
+    total = IMG_ALIGN(total);
+
+    if (out == NULL) {
+        return (ssize_t)total;
+    }
+    if (total > out_len) {
+        return BINTEX_FULL;
+    }
+
+    memset(out, 0, (size_t)total);
+    header          = (img_header*)out;
+    memcpy(header->magic, IMG_MAGIC, 4);
+    header->version = BINTEX_IMG_VERSION;
+    header->order   = IMG_ORDER;
+    header->count   = (uint32_t)count;
+    header->size    = total;
+
+    entry = (img_entry*)(header + 1);
+    total = sizeof(img_header) + (count * sizeof(img_entry));
+    for (i=0; i<count; i++, entry++) {
+        if ((names != NULL) && (names[i] != NULL)) {
+            strncpy(entry->name, names[i], BINTEX_IMGNAME-1);
+        }
+        entry->slot     = IMG_ALIGN(total);
+        entry->slots    = tpls[i].slots;
+        entry->frame    = entry->slot + (tpls[i].slots * sizeof(bintex_slot));
+        entry->frame_len= tpls[i].frame_len;
+        total           = entry->frame + entry->frame_len;
+
+        if (tpls[i].slots != 0) {
+            memcpy(out + entry->slot, tpls[i].slot, tpls[i].slots * sizeof(bintex_slot));
+        }
+        if (tpls[i].frame_len != 0) {
+            memcpy(out + entry->frame, tpls[i].frame, tpls[i].frame_len);
+        }
+    }
+
+    return (ssize_t)header->size;
+}
+
+
+int bintex_img_open(bintex_img* img, const void* data, size_t len) {
+    const img_header*   header = data;
+    const img_entry*    entry;
+    uint32_t            i;
+
+    memset(img, 0, sizeof(bintex_img));
+
+    // The header and entry table are checked here, so templates can be taken
+    // from the image without further checks
+    if ((len < sizeof(img_header)) || (((uintptr_t)data & 7) != 0)) {
+        return BINTEX_ERROR;
+    }
+    if ((memcmp(header->magic, IMG_MAGIC, 4) != 0)
+    ||  (header->version != BINTEX_IMG_VERSION)
+    ||  (header->order != IMG_ORDER)
+    ||  (header->size > len)
+    ||  (header->size < sizeof(img_header))
+    ||  (header->count > ((header->size - sizeof(img_header)) / sizeof(img_entry)))) {
+        return BINTEX_ERROR;
+    }
+
+    entry = (const img_entry*)(header + 1);
+    for (i=0; i<header->count; i++) {
+        if (sub_checkentry(data, &entry[i], header->size) != 0) {
+            return BINTEX_ERROR;
+        }
+    }
+
+    img->base   = data;
+    img->size   = (size_t)header->size;
+    img->count  = header->count;
+    return 0;
+}
+
+
+int bintex_img_get(const bintex_img* img, size_t index, bintex_tpl* tpl) {
+    const img_entry* entry;
+
+    if (index >= img->count) {
+        return BINTEX_ERROR;
+    }
+
+    // The template refers to the image, and must not be freed
+    entry           = (const img_entry*)((const img_header*)img->base + 1) + index;
+    tpl->frame      = (uint8_t*)img->base + entry->frame;
+    tpl->frame_len  = (size_t)entry->frame_len;
+    tpl->slot       = (bintex_slot*)((uint8_t*)img->base + entry->slot);
+    tpl->slots      = (size_t)entry->slots;
+    return 0;
+}
+
+
+int bintex_img_find(const bintex_img* img, const char* name) {
+    const img_entry*    entry;
+    size_t              i;
+
+    entry = (const img_entry*)((const img_header*)img->base + 1);
+    for (i=0; i<img->count; i++) {
+        if (strncmp(entry[i].name, name, BINTEX_IMGNAME) == 0) {
+            return (int)i;
+        }
+    }
+    return BINTEX_ERROR;
+}
+
+
+#if defined(__unix__) || defined(__APPLE__)
+int bintex_img_load(bintex_img* img, const char* path) {
+    struct stat st;
+    void*       map;
+    int         fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return BINTEX_ERROR;
+    }
+    if ((fstat(fd, &st) != 0) || !S_ISREG(st.st_mode) || (st.st_size == 0)) {
+        close(fd);
+        return BINTEX_ERROR;
+    }
+
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return BINTEX_ERROR;
+    }
+
+    if (bintex_img_open(img, map, (size_t)st.st_size) != 0) {
+        munmap(map, (size_t)st.st_size);
+        return BINTEX_ERROR;
+    }
+    img->map_len = (size_t)st.st_size;
+    return 0;
+}
+
+
+void bintex_img_close(bintex_img* img) {
+    if (img->map_len != 0) {
+        munmap((void*)img->base, img->map_len);
+    }
+    memset(img, 0, sizeof(bintex_img));
+}
+#endif
+
+
+
+
+/// Checks that an entry's tables lie in the image, and that its slots are in
+/// order and inside its frame, as bintex_tpl_render() expects.
+static int sub_checkentry(const uint8_t* base, const img_entry* entry, uint64_t size) {
+    const bintex_slot*  slot;
+    uint64_t            pos = 0;
+    uint64_t            i;
+
+    if (((entry->slot & 7) != 0)
+    ||  (entry->slot > size)
+    ||  (entry->slots > ((size - entry->slot) / sizeof(bintex_slot)))
+    ||  (entry->frame > size)
+    ||  (entry->frame_len > (size - entry->frame))) {
+        return -1;
+    }
+
+    slot = (const bintex_slot*)(base + entry->slot);
+    for (i=0; i<entry->slots; i++, slot++) {
+        if (slot->offset < pos) {
+            return -1;
+        }
+        pos = slot->offset;
+        switch (slot->type) {
+            case BINTEX_SLOT_NUM:
+                if ((slot->size != 1) && (slot->size != 2) && (slot->size != 4)) {
+                    return -1;
+                }
+                pos += slot->size;
+                break;
+            case BINTEX_SLOT_BYTES:
+                pos += slot->size;
+                break;
+            case BINTEX_SLOT_VAR:
+                break;
+            default:
+                return -1;
+        }
+        if (pos > entry->frame_len) {
+            return -1;
+        }
+    }
+    return 0;
+}
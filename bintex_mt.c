@@ -0,0 +1,516 @@
+/*  Copyright 2010-2018, JP Norair
+  *
+  * Licensed under the OpenTag License, Version 1.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  * http://www.indigresso.com/wiki/doku.php?id=opentag:license_1_0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  */
+
+/**
+  * @file       bintex_mt.c
+  * @author     JP Norair
+  * @version    V1.1
+  * @date       27 Jun 2018
+  * @brief      Multi-threaded BinTex parsing of large inputs
+  * @ingroup    BinTex
+  *
+  * Input is split into chunks after the first newline past each chunk size,
+  * each chunk is parsed by a worker thread into its own growable queue, and
+  * the queues are gathered into the output in order.  A chunk that was cut
+  * inside an expression is found from where its parse ended, and is parsed
+  * again with the chunks after it.  The output, return value and stopping
+  * point are the same as those of bintex_sn().
+  ******************************************************************************
+  */
+
+#include "bintex.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#   include <fcntl.h>
+#   include <pthread.h>
+#   include <unistd.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#endif
+
+// Smallest chunk given to a thread, and smallest input that is split at all
+#ifndef BINTEX_MT_MINCHUNK
+#   define BINTEX_MT_MINCHUNK   (256*1024)
+#endif
+#ifndef BINTEX_MT_MINSIZE
+#   define BINTEX_MT_MINSIZE    (1024*1024)
+#endif
+
+// Number of batch items claimed by a thread at a time
+#ifndef BINTEX_BATCH_BLOCK
+#   define BINTEX_BATCH_BLOCK   64
+#endif
+
+/// Work shared by the threads of one parallel parse
+typedef struct {
+    const uint8_t*  in;
+    size_t*         bounds;
+    size_t          count;
+    size_t          next;
+    bintex_q*       queues;
+    int*            errors;
+    size_t*         stops;
+} mt_job;
+
+/// How the parse of a chunk ended
+typedef enum {
+    CHUNK_clean = 0,
+    CHUNK_stop,
+    CHUNK_cut
+} Chunk_end;
+
+/// Result of one batch item, in the queue of the thread that parsed it
+typedef struct {
+    size_t          offset;
+    size_t          length;
+    int             queue;
+    int             error;
+} mt_item;
+
+/// Work shared by the threads of one batch
+typedef struct {
+    const uint8_t* const* in;
+    const size_t*   in_len;
+    size_t          count;
+    size_t          next;
+    int             workers;
+    bintex_q*       queues;
+    mt_item*        items;
+} mt_batch;
+
+
+static void sub_mtrun(void* (*worker)(void*), void* job, int threads, size_t units);
+static size_t sub_mtbounds(const uint8_t* in, size_t in_len, size_t chunk, size_t* bounds, size_t max);
+static void* sub_mtworker(void* arg);
+static Chunk_end sub_mtend(const mt_job* job, size_t i, int error, size_t stop);
+static ssize_t sub_mtjoin(mt_job* job, size_t i, uint8_t* out, size_t out_len, size_t* total);
+static ssize_t sub_mtgather(mt_job* job, size_t in_len, uint8_t* out, size_t out_len);
+static void* sub_batchworker(void* arg);
+static int sub_batchone(const uint8_t* in, size_t in_len, uint8_t* out, size_t out_len, size_t* length);
+
+
+
+
+/// Puts a bound after the first newline in each chunk-sized window of the
+/// input, past the first one.  The bounds are not checked against the
+/// grammar: that is done by the workers, see sub_mtend().  A window with no
+/// newline gets no bound.  The last bound is the end of the input.
+static size_t sub_mtbounds(const uint8_t* in, size_t in_len, size_t chunk, size_t* bounds, size_t max) {
+    size_t  count = 0;
+    size_t  pos;
+
+    for (pos=chunk; (pos < in_len) && ((count+1) < max); pos+=chunk) {
+        size_t          window  = ((in_len - pos) < chunk) ? (in_len - pos) : chunk;
+        const uint8_t*  line    = memchr(in + pos, '\n', window);
+
+        if ((line != NULL) && ((size_t)(line + 1 - in) < in_len)) {
+            bounds[count++] = line + 1 - in;
+        }
+    }
+
+    bounds[count++] = in_len;
+    return count;
+}
+
+
+
+
+#if defined(__unix__) || defined(__APPLE__)
+ssize_t bintex_par_sn(const uint8_t* in, size_t in_len, uint8_t* out, size_t out_len, int threads) {
+    mt_job      job;
+    size_t      chunk;
+    size_t      max;
+    size_t      i;
+    ssize_t     rc;
+
+    if (threads <= 0) {
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if ((threads <= 1) || (in_len < BINTEX_MT_MINSIZE)) {
+        return bintex_sn(in, in_len, out, out_len);
+    }
+
+    // Several chunks per thread, so threads that finish early can take more
+    chunk = in_len / ((size_t)threads * 4);
+    chunk = (chunk < BINTEX_MT_MINCHUNK) ? BINTEX_MT_MINCHUNK : chunk;
+    max   = (in_len / chunk) + 1;
+
+    memset(&job, 0, sizeof(job));
+    job.bounds  = malloc(max * sizeof(size_t));
+    if (job.bounds == NULL) {
+        goto bintex_par_sn_serial;
+    }
+
+    job.in      = in;
+    job.count   = sub_mtbounds(in, in_len, chunk, job.bounds, max);
+    if (job.count < 2) {
+        goto bintex_par_sn_serial;
+    }
+    job.queues  = calloc(job.count, sizeof(bintex_q));
+    job.errors  = malloc(job.count * sizeof(int));
+    job.stops   = malloc(job.count * sizeof(size_t));
+    if ((job.queues == NULL) || (job.errors == NULL) || (job.stops == NULL)) {
+        goto bintex_par_sn_serial;
+    }
+
+    sub_mtrun(&sub_mtworker, &job, threads, job.count);
+    rc = sub_mtgather(&job, in_len, out, out_len);
+
+    for (i=0; i<job.count; i++) {
+        bintex_q_free(&job.queues[i]);
+    }
+    free(job.queues);
+    free(job.errors);
+    free(job.stops);
+    free(job.bounds);
+    return rc;
+
+    bintex_par_sn_serial:
+    free(job.queues);
+    free(job.errors);
+    free(job.stops);
+    free(job.bounds);
+    return bintex_sn(in, in_len, out, out_len);
+}
+
+
+ssize_t bintex_batch(const uint8_t* const* in, const size_t* in_len, size_t count,
+                     uint8_t* out, size_t out_len, size_t* offsets, size_t* lengths,
+                     int* status, int threads) {
+    mt_batch    job;
+    size_t      total = 0;
+    size_t      i;
+    int         w;
+
+    if (threads <= 0) {
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if ((threads <= 1) || (count < (2*BINTEX_BATCH_BLOCK))) {
+        goto bintex_batch_serial;
+    }
+    
+    // Each thread parses the items it claims into its own growable queue
+    memset(&job, 0, sizeof(job));
+    job.in      = in;
+    job.in_len  = in_len;
+    job.count   = count;
+    job.queues  = calloc(threads, sizeof(bintex_q));
+    job.items   = malloc(count * sizeof(mt_item));
+    if ((job.queues == NULL) || (job.items == NULL)) {
+        free(job.queues);
+        free(job.items);
+        goto bintex_batch_serial;
+    }
+    sub_mtrun(&sub_batchworker, &job, threads, (count + BINTEX_BATCH_BLOCK - 1) / BINTEX_BATCH_BLOCK);
+
+    // Gather the items in order.  An item that couldn't get memory is parsed
+    // again here, straight into the output.
+    for (i=0; i<count; i++) {
+        mt_item* item = &job.items[i];
+        
+        if (item->error == BINTEX_FULL) {
+            size_t len  = (in_len == NULL) ? strlen((const char*)in[i]) : in_len[i];
+            item->error = sub_batchone(in[i], len, out + total, out_len - total, &item->length);
+            if (item->error == BINTEX_FULL) break;
+        }
+        else if (item->length > (out_len - total)) {
+            break;
+        }
+        else {
+            memcpy(out + total, job.queues[item->queue].front + item->offset, item->length);
+        }
+        
+        offsets[i]  = total;
+        lengths[i]  = item->length;
+        total      += item->length;
+        if (status != NULL) {
+            status[i] = item->error;
+        }
+    }
+    
+    for (w=0; w<threads; w++) {
+        bintex_q_free(&job.queues[w]);
+    }
+    free(job.queues);
+    free(job.items);
+    return (ssize_t)i;
+    
+    bintex_batch_serial:
+    for (i=0; i<count; i++) {
+        size_t  len = (in_len == NULL) ? strlen((const char*)in[i]) : in_len[i];
+        int     rc;
+        
+        rc = sub_batchone(in[i], len, out + total, out_len - total, &lengths[i]);
+        if (rc == BINTEX_FULL) break;
+        
+        offsets[i]  = total;
+        total      += lengths[i];
+        if (status != NULL) {
+            status[i] = rc;
+        }
+    }
+    return (ssize_t)i;
+}
+
+
+ssize_t bintex_par_path(const char* path, uint8_t* out, size_t out_len, int threads) {
+    struct stat st;
+    uint8_t*    map;
+    int         fd;
+    ssize_t     rc;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return BINTEX_ERROR;
+    }
+    if ((fstat(fd, &st) != 0) || !S_ISREG(st.st_mode) || (st.st_size == 0)) {
+        rc = bintex_fd(fd, out, out_len);
+        close(fd);
+        return rc;
+    }
+
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return BINTEX_ERROR;
+    }
+
+    rc = bintex_par_sn(map, (size_t)st.st_size, out, out_len, threads);
+    munmap(map, (size_t)st.st_size);
+    return rc;
+}
+
+
+/// Runs worker on up to threads threads, including the calling thread, but not 
+/// on more threads than there are units of work.  If threads can't be created,
+/// the work is done by those that were.
+static void sub_mtrun(void* (*worker)(void*), void* job, int threads, size_t units) {
+    pthread_t*  pool;
+    int         spawned = 0;
+    
+    if ((size_t)threads > units) {
+        threads = (int)units;
+    }
+    pool = malloc(threads * sizeof(pthread_t));
+    if (pool != NULL) {
+        while (spawned < (threads-1)) {
+            if (pthread_create(&pool[spawned], NULL, worker, job) != 0) {
+                break;
+            }
+            spawned++;
+        }
+    }
+    worker(job);
+    while (spawned > 0) {
+        pthread_join(pool[--spawned], NULL);
+    }
+    free(pool);
+}
+
+
+static void* sub_mtworker(void* arg) {
+    mt_job* job = arg;
+    size_t  i;
+
+    while ((i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->count) {
+        bintex_ctx  ctx;
+        size_t      start   = (i == 0) ? 0 : job->bounds[i-1];
+        size_t      len     = job->bounds[i] - start;
+
+        // Hex input is about twice the size of its output
+        if (bintex_q_init_grow(&job->queues[i], (len/2) + 64, NULL, NULL) != 0) {
+            job->errors[i]  = BINTEX_FULL;
+            job->stops[i]   = start;
+            continue;
+        }
+        bintex_ctx_init(&ctx);
+        bintex_snq_r(&ctx, job->in + start, len, &job->queues[i]);
+        job->errors[i]  = ctx.error;
+        job->stops[i]   = ctx.cursor - job->in;
+    }
+    return NULL;
+}
+
+
+/// Finds where a chunk's parse would have to stop if its end is between
+/// expressions.  Past its bound, the parser of a chunk reads EOF: a clean EOF
+/// there is the end of an expression, while an unterminated string or block
+/// is an error at the bound.  Anything that stops before the bound (';', an
+/// error, a NUL or a full output) also stops bintex_sn() at the same place,
+/// as does the end of the last chunk.
+static Chunk_end sub_mtend(const mt_job* job, size_t i, int error, size_t stop) {
+    if ((i == (job->count - 1)) || (stop < job->bounds[i])) {
+        return CHUNK_stop;
+    }
+    return (error == BINTEX_EOF) ? CHUNK_clean : CHUNK_cut;
+}
+
+
+/// Parses the input from chunk i straight into the output, up to the end of
+/// a later chunk, until the parse ends between expressions or stops.  The
+/// span is doubled on each try, so a long cut expression is parsed about 
+/// twice at most.  Returns the next chunk to gather, the chunk count if the
+/// parse stopped, or BINTEX_FULL.
+static ssize_t sub_mtjoin(mt_job* job, size_t i, uint8_t* out, size_t out_len, size_t* total) {
+    size_t  start   = (i == 0) ? 0 : job->bounds[i-1];
+    size_t  span    = 1;
+    size_t  j;
+
+    while (1) {
+        bintex_ctx  ctx;
+        Chunk_end   state;
+        ssize_t     rc;
+
+        j       = ((i + span) < job->count) ? (i + span) : (job->count - 1);
+        span   *= 2;
+
+        bintex_ctx_init(&ctx);
+        rc      = bintex_sn_r(&ctx, job->in + start, job->bounds[j] - start, out + *total, out_len - *total);
+        state   = sub_mtend(job, j, ctx.error, ctx.cursor - job->in);
+        if (rc < 0) {
+            return rc;
+        }
+        if (state != CHUNK_cut) {
+            *total += (size_t)rc;
+            return (ssize_t)((state == CHUNK_clean) ? (j + 1) : job->count);
+        }
+    }
+}
+
+
+static ssize_t sub_mtgather(mt_job* job, size_t in_len, uint8_t* out, size_t out_len) {
+    size_t  total = 0;
+    size_t  i = 0;
+
+    while (i < job->count) {
+        bintex_q*   q       = &job->queues[i];
+        size_t      start   = (i == 0) ? 0 : job->bounds[i-1];
+        size_t      len     = q->putcursor - q->front;
+        Chunk_end   state   = CHUNK_stop;
+
+        if (job->errors[i] != BINTEX_FULL) {
+            state = sub_mtend(job, i, job->errors[i], job->stops[i]);
+            if (state == CHUNK_cut) {
+                ssize_t next = sub_mtjoin(job, i, out, out_len, &total);
+                if (next < 0) {
+                    return next;
+                }
+                i = (size_t)next;
+                continue;
+            }
+        }
+
+        // When a chunk couldn't get memory, or doesn't fit in the output, the
+        // rest of the input is parsed in order, so it stops where bintex_sn()
+        // would stop.  bintex_sn() needs room for 4 bytes before it writes a
+        // decimal number of any size, so a chunk must fit with 4 to spare.
+        // An invalid string or block is written before it is removed, so a
+        // chunk that ends in an error is parsed again too: bintex_sn() may
+        // find the output full before it finds the error.
+        if ((job->errors[i] == BINTEX_FULL) || (job->errors[i] == BINTEX_ERROR)
+        ||  ((len + 4) > (out_len - total))) {
+            ssize_t rc;
+            rc      = bintex_sn(job->in + start, in_len - start, out + total, out_len - total);
+            if (rc < 0) {
+                return rc;
+            }
+            total  += (size_t)rc;
+            break;
+        }
+
+        memcpy(out + total, q->front, len);
+        total += len;
+
+        // The parser stops at an error or ';', and the chunks after it are
+        // not used.
+        if (state == CHUNK_stop) {
+            break;
+        }
+        i++;
+    }
+
+    return (ssize_t)total;
+}
+
+
+static void* sub_batchworker(void* arg) {
+    mt_batch*   job = arg;
+    bintex_q*   q;
+    size_t      block;
+    int         w;
+    int         rc;
+    
+    w   = __atomic_fetch_add(&job->workers, 1, __ATOMIC_RELAXED);
+    q   = &job->queues[w];
+    rc  = bintex_q_init_grow(q, 4096, NULL, NULL);
+    
+    while ((block = __atomic_fetch_add(&job->next, BINTEX_BATCH_BLOCK, __ATOMIC_RELAXED)) < job->count) {
+        size_t i;
+        size_t end = block + BINTEX_BATCH_BLOCK;
+        
+        for (i=block; (i < end) && (i < job->count); i++) {
+            mt_item*    item = &job->items[i];
+            bintex_ctx  ctx;
+            size_t      len;
+            
+            item->queue     = w;
+            item->offset    = q->putcursor - q->front;
+            item->error     = BINTEX_FULL;
+            if (rc == 0) {
+                len = (job->in_len == NULL) ? strlen((const char*)job->in[i]) : job->in_len[i];
+                bintex_ctx_init(&ctx);
+                item->length    = bintex_snq_r(&ctx, job->in[i], len, q);
+                item->error     = ctx.error;
+            }
+        }
+    }
+    return NULL;
+}
+
+
+/// Parses one batch item into the output.  An item that doesn't fit is not
+/// output, and BINTEX_FULL is returned.
+static int sub_batchone(const uint8_t* in, size_t in_len, uint8_t* out, size_t out_len, size_t* length) {
+    bintex_ctx  ctx;
+    bintex_q    q;
+    ssize_t     rc;
+    
+    bintex_ctx_init(&ctx);
+    rc = bintex_sn_r(&ctx, in, in_len, out, out_len);
+    if (ctx.error != BINTEX_FULL) {
+        *length = (size_t)rc;
+        return ctx.error;
+    }
+    
+    // The parser reserves room for a whole token before writing it, so an 
+    // item near the end of out can be refused though its output would fit.
+    *length = 0;
+    if (bintex_q_init_grow(&q, 0, NULL, NULL) == 0) {
+        bintex_ctx_init(&ctx);
+        rc = bintex_snq_r(&ctx, in, in_len, &q);
+        if ((ctx.error != BINTEX_FULL) && ((size_t)rc <= out_len)) {
+            memcpy(out, q.front, (size_t)rc);
+            *length = (size_t)rc;
+        }
+        else {
+            ctx.error = BINTEX_FULL;
+        }
+        bintex_q_free(&q);
+    }
+    return ctx.error;
+}
+#endif